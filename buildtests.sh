@@ -1,9 +1,13 @@
 rm -rf build
 mkdir build
 cp test_inputs/* build/
+SOURCES="src/quicklight.c src/qlrender.c src/qslt.c src/qlstats.c src/qlpool.c src/qlscene.c src/qlbatch.c src/qlstream.c src/qlmesh.c src/qlpost.c src/qlocclusion.c src/qlchunk.c src/qldist.c src/qlreplay.c src/qllod.c"
 for file in $(ls tests)
 do
     echo "Building $file..."
-    gcc -o build/$file.out tests/$file src/quicklight.c src/qlrender.c src/qslt.c -g -lm -lX11 -Wall -Werror
+    FLAGS=$QLFLAGS
+    # The instrumentation test needs the counters whatever the other tests are built with
+    if [ "$file" = "stats_test.c" ]; then FLAGS="$FLAGS -DQL_STATS"; fi
+    gcc -o build/$file.out tests/$file $SOURCES -g -lm -lX11 -lpthread -Wall -Werror $FLAGS
     echo "Built."
 done
\ No newline at end of file
@@ -0,0 +1,123 @@
+#include "./qlbatch.h"
+#include <stdlib.h>
+/*
+Copyright (c) 2020 Amélia O. F. da S.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+qlbatch *Qlbatch(qlcamera **cams,int n,qlscene *scene,int threads)
+{
+    qlbatch *ret;
+    int i;
+    if(!cams||n<=0||!scene)return NULL;
+    for(i=0;i<n;i++)if(!cams[i])return NULL;
+    ret=malloc(sizeof(qlbatch));
+    ret->cams=cams;
+    ret->n=n;
+    ret->scene=scene;
+    ret->pool=Qlpool(threads);
+    ret->visible=malloc(sizeof(const qltri**)*n);
+    ret->out=malloc(sizeof(FILE*)*n);
+    ret->rowjobs=malloc(sizeof(int)*(n+1));
+    ret->occ=NULL;
+    for(i=0;i<n;i++)
+    {
+        ret->visible[i]=malloc(sizeof(const qltri*)*(scene->len+1));
+        ret->visible[i][0]=NULL;
+        ret->out[i]=NULL;
+    }
+    return ret;
+}
+
+void qlbatchoutput(qlbatch *batch,int view,FILE *f)
+{
+    if(!batch||view<0||view>=batch->n)return;
+    batch->out[view]=f;
+}
+
+void qlbatchocclusion(qlbatch *batch,char enable)
+{
+    int i;
+    if(!batch||!enable==!batch->occ)return;
+    if(enable)
+    {
+        batch->occ=malloc(sizeof(qlocclusion*)*batch->n);
+        for(i=0;i<batch->n;i++)batch->occ[i]=Qlocclusion(batch->cams[i]);
+    }
+    else
+    {
+        for(i=0;i<batch->n;i++)freeqlocclusion(&batch->occ[i]);
+        free(batch->occ);
+        batch->occ=NULL;
+    }
+}
+
+static void qlbatchcull(void *arg,int view)
+{
+    qlbatch *batch=arg;
+    qlscenecull(batch->scene,batch->cams[view],batch->visible[view]);
+    if(batch->occ)qlocclusioncull(batch->occ[view],batch->cams[view],batch->visible[view]);
+}
+
+static void qlbatchtrace(void *arg,int job)
+{
+    qlbatch *batch=arg;
+    qlcamera *cam;
+    int view=0,y0,y1;
+    while(batch->rowjobs[view+1]<=job)view++;
+    cam=batch->cams[view];
+    y0=(job-batch->rowjobs[view])*QL_BATCH_ROWS;
+    y1=y0+QL_BATCH_ROWS<cam->image->h?y0+QL_BATCH_ROWS:cam->image->h;
+    qltracerows(cam,batch->visible[view],y0,y1);
+}
+
+static void qlbatchshade(void *arg,int view)
+{
+    qlbatch *batch=arg;
+    if(batch->occ)qlocclusionstore(batch->occ[view],batch->cams[view]);
+    qlshade(batch->cams[view]);
+    if(batch->out[view])qlrasterwriteppm(batch->cams[view]->image,batch->out[view]);
+}
+
+void qlbatchrender(qlbatch *batch)
+{
+    int i;
+    if(!batch)return;
+    batch->rowjobs[0]=0;
+    for(i=0;i<batch->n;i++)
+        batch->rowjobs[i+1]=batch->rowjobs[i]+(batch->cams[i]->image->h+QL_BATCH_ROWS-1)/QL_BATCH_ROWS;
+    qlpoolrun(batch->pool,batch->n,qlbatchcull,batch);
+    qlpoolrun(batch->pool,batch->rowjobs[batch->n],qlbatchtrace,batch);
+    qlpoolrun(batch->pool,batch->n,qlbatchshade,batch);
+}
+
+void freeqlbatch(qlbatch **batch)
+{
+    int i;
+    if(!batch||!(*batch))return;
+    freeqlpool(&(*batch)->pool);
+    qlbatchocclusion(*batch,0);
+    for(i=0;i<(*batch)->n;i++)free((*batch)->visible[i]);
+    free((*batch)->visible);
+    free((*batch)->out);
+    free((*batch)->rowjobs);
+    free(*batch);
+    *batch=NULL;
+}
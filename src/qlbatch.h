@@ -0,0 +1,75 @@
+/*
+Quicklight raycaster-like renderer - Batch rendering
+
+Copyright (c) 2020 Amélia O. F. da S.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#ifndef QLBATCH
+#define QLBATCH
+
+#include <stdio.h>
+#include "./quicklight.h"
+#include "./qlscene.h"
+#include "./qlocclusion.h"
+#include "./qlpool.h"
+
+/*Number of image rows traced by each job*/
+#define QL_BATCH_ROWS 8
+
+/*
+A batch of views of the same scene.
+Every view is culled, traced and shaded on a shared pool of threads, and written to its own camera's raster
+(and, optionally, to an output stream).
+*/
+typedef struct _qlbatch{
+    qlcamera **cams;/*Cameras of each view (not owned by the batch)*/
+    int n;/*Number of views*/
+    qlscene *scene;/*Scene shared by every view (not owned by the batch)*/
+    qlpool *pool;/*Worker threads shared by every view*/
+    const qltri ***visible;/*NULL-terminated list of the triangles left by culling, for each view*/
+    FILE **out;/*Stream each view is written to after it's rendered, as a PPM image (or NULL)*/
+    int *rowjobs;/*Index of the first trace job of each view (and the total number of jobs at rowjobs[n])*/
+    qlocclusion **occ;/*Occlusion culling state of each view (NULL when disabled)*/
+} qlbatch;
+/*
+Instantiates a qlbatch object rendering the n cameras at cams from the scene.
+threads is the size of the pool (threads<=0 uses one thread per online CPU).
+One should free it with freeqlbatch.
+*/
+qlbatch *Qlbatch(qlcamera **cams,int n,qlscene *scene,int threads);
+/*Sets the stream view <view> is written to after each render (NULL stops writing it)*/
+void qlbatchoutput(qlbatch *batch,int view,FILE *f);
+/*
+Enables (enable=1) or disables (enable=0) occlusion culling against each view's previous render.
+The scene's triangles must not move while it's enabled.
+*/
+void qlbatchocclusion(qlbatch *batch,char enable);
+/*
+Renders every view of the batch: culls the scene for each camera (and against its previous render, if enabled), traces all the views' rows
+as one set of jobs and shades them.
+Cameras must be up to date (see qlupdatecamera).
+*/
+void qlbatchrender(qlbatch *batch);
+/*Frees a qlbatch object (but not its cameras or scene)*/
+void freeqlbatch(qlbatch **batch);
+
+#endif
@@ -0,0 +1,451 @@
+#include "./qlchunk.h"
+#include "./qlscene.h"
+#include "./qlvect.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+/*
+Copyright (c) 2020 Amélia O. F. da S.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#define QL_CHUNK_HEADER 12
+#define QL_CHUNK_ENTRY 40
+#define QL_CHUNK_TRI 40
+
+static void qlput32(unsigned char *p,unsigned int v)
+{
+    p[0]=v;
+    p[1]=v>>8;
+    p[2]=v>>16;
+    p[3]=v>>24;
+}
+
+static unsigned int qlget32(const unsigned char *p)
+{
+    return p[0]|(p[1]<<8)|(p[2]<<16)|((unsigned int)p[3]<<24);
+}
+
+static void qlputfloat(unsigned char *p,float f)
+{
+    unsigned int u;
+    memcpy(&u,&f,4);
+    qlput32(p,u);
+}
+
+static float qlgetfloat(const unsigned char *p)
+{
+    unsigned int u=qlget32(p);
+    float ret;
+    memcpy(&ret,&u,4);
+    return ret;
+}
+
+/*Grid cell of a triangle, for sorting the triangles into chunks*/
+typedef struct _qlchunkcell{
+    long long x,y,z;
+    int tri;
+} qlchunkcell;
+
+static int qlchunkcellcmp(const void *a,const void *b)
+{
+    const qlchunkcell *p=a,*q=b;
+    if(p->x!=q->x)return p->x<q->x?-1:1;
+    if(p->y!=q->y)return p->y<q->y?-1:1;
+    if(p->z!=q->z)return p->z<q->z?-1:1;
+    return p->tri-q->tri;
+}
+
+static void qlchunkgrow(qlvect *min,qlvect *max,const qlvect *v)
+{
+    if(v->x<min->x)min->x=v->x;
+    if(v->y<min->y)min->y=v->y;
+    if(v->z<min->z)min->z=v->z;
+    if(v->x>max->x)max->x=v->x;
+    if(v->y>max->y)max->y=v->y;
+    if(v->z>max->z)max->z=v->z;
+}
+
+int qlchunkwrite(const char *fname,const qltri **tris,double size)
+{
+    FILE *f;
+    qlchunkcell *cells;
+    unsigned char entry[QL_CHUNK_ENTRY],rec[QL_CHUNK_TRI];
+    const qltri *t;
+    qlvect c,min,max;
+    unsigned long long offset;
+    int len,n,i,j,k,ok=1;
+    if(!fname||!tris||!(size>0))return -1;
+    for(len=0;tris[len];len++){}
+    cells=malloc(sizeof(qlchunkcell)*(len+1));
+    for(i=0;i<len;i++)
+    {
+        c=qlvscale(qlvsum(qlvsum(tris[i]->a,tris[i]->b),tris[i]->c),1.0/3);
+        cells[i].x=floor(c.x/size);
+        cells[i].y=floor(c.y/size);
+        cells[i].z=floor(c.z/size);
+        cells[i].tri=i;
+    }
+    qsort(cells,len,sizeof(qlchunkcell),qlchunkcellcmp);
+    for(i=0,n=0;i<len;i++)
+        if(!i||cells[i-1].x!=cells[i].x||cells[i-1].y!=cells[i].y||cells[i-1].z!=cells[i].z)n++;
+    f=fopen(fname,"wb");
+    if(!f){free(cells);return -1;}
+    fwrite("QLCHUNK1",1,8,f);
+    qlput32(entry,n);
+    fwrite(entry,1,4,f);
+    /*Chunk table*/
+    offset=QL_CHUNK_HEADER+(unsigned long long)QL_CHUNK_ENTRY*n;
+    for(i=0;i<len;i=j)
+    {
+        t=tris[cells[i].tri];
+        min=max=t->a;
+        for(j=i;j<len&&cells[j].x==cells[i].x&&cells[j].y==cells[i].y&&cells[j].z==cells[i].z;j++)
+        {
+            t=tris[cells[j].tri];
+            qlchunkgrow(&min,&max,&t->a);
+            qlchunkgrow(&min,&max,&t->b);
+            qlchunkgrow(&min,&max,&t->c);
+        }
+        qlputfloat(entry,min.x);
+        qlputfloat(entry+4,min.y);
+        qlputfloat(entry+8,min.z);
+        qlputfloat(entry+12,max.x);
+        qlputfloat(entry+16,max.y);
+        qlputfloat(entry+20,max.z);
+        qlput32(entry+24,offset);
+        qlput32(entry+28,offset>>32);
+        qlput32(entry+32,j-i);
+        qlput32(entry+36,0);
+        if(fwrite(entry,1,QL_CHUNK_ENTRY,f)!=QL_CHUNK_ENTRY)ok=0;
+        offset+=(unsigned long long)QL_CHUNK_TRI*(j-i);
+    }
+    /*Triangles, in the same order*/
+    for(i=0;i<len;i++)
+    {
+        t=tris[cells[i].tri];
+        for(k=0;k<3;k++)
+        {
+            c=k==0?t->a:k==1?t->b:t->c;
+            qlputfloat(rec+k*12,c.x);
+            qlputfloat(rec+k*12+4,c.y);
+            qlputfloat(rec+k*12+8,c.z);
+        }
+        memcpy(rec+36,t->colour,3);
+        rec[39]=0;
+        if(fwrite(rec,1,QL_CHUNK_TRI,f)!=QL_CHUNK_TRI)ok=0;
+    }
+    free(cells);
+    if(fclose(f)!=0)ok=0;
+    return ok?n:-1;
+}
+
+/*Reads from the file at an offset, as many times as needed*/
+static int qlchunkpread(int fd,unsigned char *p,size_t len,long long offset)
+{
+    ssize_t r;
+    while(len)
+    {
+        r=pread(fd,p,len,offset);
+        if(r<=0)return -1;
+        p+=r;
+        len-=r;
+        offset+=r;
+    }
+    return 0;
+}
+
+/*Reads a chunk's triangles (runs on the loader thread, without the lock)*/
+static qltri *qlchunkread(int fd,const qlchunk *chunk)
+{
+    unsigned char *buf,*rec;
+    qltri *ret;
+    int i;
+    buf=malloc((size_t)QL_CHUNK_TRI*chunk->ntris+1);
+    ret=malloc(sizeof(qltri)*chunk->ntris+1);
+    if(!buf||!ret||qlchunkpread(fd,buf,(size_t)QL_CHUNK_TRI*chunk->ntris,chunk->offset))
+    {
+        free(buf);
+        free(ret);
+        return NULL;
+    }
+    for(i=0;i<chunk->ntris;i++)
+    {
+        rec=buf+(size_t)QL_CHUNK_TRI*i;
+        ret[i].a=qlv(qlgetfloat(rec),qlgetfloat(rec+4),qlgetfloat(rec+8));
+        ret[i].b=qlv(qlgetfloat(rec+12),qlgetfloat(rec+16),qlgetfloat(rec+20));
+        ret[i].c=qlv(qlgetfloat(rec+24),qlgetfloat(rec+28),qlgetfloat(rec+32));
+        memcpy(ret[i].colour,rec+36,3);
+    }
+    free(buf);
+    return ret;
+}
+
+static void *qlchunksloader(void *arg)
+{
+    qlchunks *chunks=arg;
+    qlchunk *chunk;
+    qltri *tris;
+    pthread_mutex_lock(&chunks->lock);
+    while(!chunks->quit)
+    {
+        if(chunks->next>=chunks->queued)
+        {
+            pthread_cond_broadcast(&chunks->idle);
+            pthread_cond_wait(&chunks->work,&chunks->lock);
+            continue;
+        }
+        chunk=&chunks->chunks[chunks->queue[chunks->next++]];
+        if(chunk->state!=QL_CHUNK_QUEUED)continue;
+        chunk->state=QL_CHUNK_LOADING;
+        chunks->busy=1;
+        pthread_mutex_unlock(&chunks->lock);
+        tris=qlchunkread(chunks->fd,chunk);
+        pthread_mutex_lock(&chunks->lock);
+        chunks->busy=0;
+        if(tris)
+        {
+            chunk->tris=tris;
+            chunk->state=QL_CHUNK_IN;
+            chunks->loads++;
+        }
+        else
+        {
+            chunk->state=QL_CHUNK_FAILED;
+            chunks->resident-=chunk->bytes;
+        }
+    }
+    pthread_mutex_unlock(&chunks->lock);
+    return NULL;
+}
+
+/*Frees everything but the loader thread*/
+static void qlchunksrelease(qlchunks *chunks)
+{
+    int i;
+    for(i=0;i<chunks->n;i++)free(chunks->chunks[i].tris);
+    free(chunks->chunks);
+    free(chunks->list);
+    free(chunks->order);
+    free(chunks->queue);
+    pthread_mutex_destroy(&chunks->lock);
+    pthread_cond_destroy(&chunks->work);
+    pthread_cond_destroy(&chunks->idle);
+    close(chunks->fd);
+    free(chunks);
+}
+
+qlchunks *Qlchunks(const char *fname,size_t budget)
+{
+    qlchunks *ret;
+    qlchunk *chunk;
+    unsigned char header[QL_CHUNK_HEADER],*table;
+    struct stat st;
+    int fd,n,i;
+    if(!fname)return NULL;
+    fd=open(fname,O_RDONLY);
+    if(fd<0)return NULL;
+    if(fstat(fd,&st)||qlchunkpread(fd,header,QL_CHUNK_HEADER,0)||memcmp(header,"QLCHUNK1",8))
+    {
+        close(fd);
+        return NULL;
+    }
+    n=qlget32(header+8);
+    if(n<0||QL_CHUNK_HEADER+(long long)QL_CHUNK_ENTRY*n>st.st_size)
+    {
+        close(fd);
+        return NULL;
+    }
+    table=malloc((size_t)QL_CHUNK_ENTRY*n+1);
+    if(qlchunkpread(fd,table,(size_t)QL_CHUNK_ENTRY*n,QL_CHUNK_HEADER))
+    {
+        free(table);
+        close(fd);
+        return NULL;
+    }
+    ret=malloc(sizeof(qlchunks));
+    ret->fd=fd;
+    ret->n=n;
+    ret->chunks=malloc(sizeof(qlchunk)*(n+1));
+    for(i=0;i<n;i++)
+    {
+        chunk=&ret->chunks[i];
+        chunk->min=qlv(qlgetfloat(table+i*QL_CHUNK_ENTRY),qlgetfloat(table+i*QL_CHUNK_ENTRY+4),qlgetfloat(table+i*QL_CHUNK_ENTRY+8));
+        chunk->max=qlv(qlgetfloat(table+i*QL_CHUNK_ENTRY+12),qlgetfloat(table+i*QL_CHUNK_ENTRY+16),qlgetfloat(table+i*QL_CHUNK_ENTRY+20));
+        chunk->center=qlvscale(qlvsum(chunk->min,chunk->max),0.5);
+        chunk->radius=sqrt(qlvdot(qlvsub(chunk->max,chunk->min),qlvsub(chunk->max,chunk->min)))/2;
+        chunk->offset=qlget32(table+i*QL_CHUNK_ENTRY+24)|((long long)qlget32(table+i*QL_CHUNK_ENTRY+28)<<32);
+        chunk->ntris=qlget32(table+i*QL_CHUNK_ENTRY+32);
+        chunk->bytes=sizeof(qltri)*(size_t)chunk->ntris;
+        chunk->tris=NULL;
+        chunk->state=QL_CHUNK_OUT;
+        /*Chunks pointing outside the file are never loaded*/
+        if(chunk->ntris<0||chunk->offset<0||chunk->offset+(long long)QL_CHUNK_TRI*chunk->ntris>st.st_size)
+            chunk->state=QL_CHUNK_FAILED;
+    }
+    free(table);
+    ret->budget=budget;
+    ret->resident=0;
+    ret->prefetch=0;
+    ret->listcap=1024;
+    ret->list=malloc(sizeof(qltri*)*ret->listcap);
+    ret->list[0]=NULL;
+    ret->order=malloc(sizeof(qlchunkkey)*(n+1));
+    ret->queue=malloc(sizeof(int)*(n+1));
+    ret->queued=0;
+    ret->next=0;
+    ret->busy=0;
+    ret->missing=0;
+    ret->loads=0;
+    ret->evictions=0;
+    ret->quit=0;
+    pthread_mutex_init(&ret->lock,NULL);
+    pthread_cond_init(&ret->work,NULL);
+    pthread_cond_init(&ret->idle,NULL);
+    if(pthread_create(&ret->thread,NULL,qlchunksloader,ret))
+    {
+        qlchunksrelease(ret);
+        return NULL;
+    }
+    return ret;
+}
+
+static int qlchunkkeycmp(const void *a,const void *b)
+{
+    const qlchunkkey *p=a,*q=b;
+    if(p->key!=q->key)return p->key<q->key?-1:1;
+    return p->chunk-q->chunk;
+}
+
+const qltri **qlchunksupdate(qlchunks *chunks,const qlcamera *camera)
+{
+    qlfrustum frustum;
+    qlchunk *chunk;
+    double dist;
+    char *inview,*keep;
+    size_t total=0;
+    int i,j,nkeys=0,len=0,need=0;
+    if(!chunks)return NULL;
+    if(!camera)return chunks->list;
+    qlcamerafrustum(camera,&frustum);
+    inview=malloc(chunks->n+1);
+    keep=calloc(chunks->n+1,1);
+    /*The chunks in view come first, then the ones around the camera, nearest first*/
+    for(i=0;i<chunks->n;i++)
+    {
+        chunk=&chunks->chunks[i];
+        inview[i]=qlfrustumsphere(&frustum,&chunk->center,chunk->radius);
+        if(chunk->state==QL_CHUNK_FAILED)continue;
+        dist=sqrt(qlvdot(qlvsub(chunk->center,camera->pos),qlvsub(chunk->center,camera->pos)))-chunk->radius;
+        if(dist<0)dist=0;
+        if(inview[i])chunks->order[nkeys].key=dist;
+        else if(dist<=chunks->prefetch)chunks->order[nkeys].key=frustum.reach+dist;
+        else continue;
+        chunks->order[nkeys++].chunk=i;
+    }
+    qsort(chunks->order,nkeys,sizeof(qlchunkkey),qlchunkkeycmp);
+
+    pthread_mutex_lock(&chunks->lock);
+    /*Keep as many of the most important chunks as the budget allows*/
+    for(i=0;i<nkeys;i++)
+    {
+        chunk=&chunks->chunks[chunks->order[i].chunk];
+        if(total+chunk->bytes>chunks->budget)break;
+        total+=chunk->bytes;
+        keep[chunks->order[i].chunk]=1;
+    }
+    nkeys=i;
+    /*Drop the others (the one being loaded is dropped at the next update, once it's in)*/
+    for(i=0;i<chunks->n;i++)
+    {
+        chunk=&chunks->chunks[i];
+        if(keep[i])continue;
+        if(chunk->state==QL_CHUNK_IN)
+        {
+            free(chunk->tris);
+            chunk->tris=NULL;
+            chunks->evictions++;
+        }
+        if(chunk->state==QL_CHUNK_IN||chunk->state==QL_CHUNK_QUEUED)
+        {
+            chunk->state=QL_CHUNK_OUT;
+            chunks->resident-=chunk->bytes;
+        }
+    }
+    /*Queue the missing ones*/
+    chunks->queued=0;
+    chunks->next=0;
+    for(i=0;i<nkeys;i++)
+    {
+        chunk=&chunks->chunks[chunks->order[i].chunk];
+        if(chunk->state==QL_CHUNK_OUT)
+        {
+            chunk->state=QL_CHUNK_QUEUED;
+            chunks->resident+=chunk->bytes;
+        }
+        if(chunk->state==QL_CHUNK_QUEUED)chunks->queue[chunks->queued++]=chunks->order[i].chunk;
+    }
+    if(chunks->queued)pthread_cond_signal(&chunks->work);
+    /*List the triangles of the loaded chunks in view*/
+    chunks->missing=0;
+    for(i=0;i<chunks->n;i++)
+    {
+        if(!inview[i])continue;
+        if(chunks->chunks[i].state==QL_CHUNK_IN)need+=chunks->chunks[i].ntris;
+        else if(chunks->chunks[i].state!=QL_CHUNK_FAILED)chunks->missing++;
+    }
+    if(need+1>chunks->listcap)
+    {
+        chunks->listcap=need+1;
+        chunks->list=realloc(chunks->list,sizeof(qltri*)*chunks->listcap);
+    }
+    for(i=0;i<chunks->n;i++)
+        if(inview[i]&&chunks->chunks[i].state==QL_CHUNK_IN)
+            for(j=0;j<chunks->chunks[i].ntris;j++)chunks->list[len++]=&chunks->chunks[i].tris[j];
+    chunks->list[len]=NULL;
+    pthread_mutex_unlock(&chunks->lock);
+    free(inview);
+    free(keep);
+    return chunks->list;
+}
+
+void qlchunkswait(qlchunks *chunks)
+{
+    if(!chunks)return;
+    pthread_mutex_lock(&chunks->lock);
+    while(chunks->next<chunks->queued||chunks->busy)pthread_cond_wait(&chunks->idle,&chunks->lock);
+    pthread_mutex_unlock(&chunks->lock);
+}
+
+void freeqlchunks(qlchunks **chunks)
+{
+    if(!chunks||!(*chunks))return;
+    pthread_mutex_lock(&(*chunks)->lock);
+    (*chunks)->quit=1;
+    pthread_cond_broadcast(&(*chunks)->work);
+    pthread_mutex_unlock(&(*chunks)->lock);
+    pthread_join((*chunks)->thread,NULL);
+    qlchunksrelease(*chunks);
+    *chunks=NULL;
+}
@@ -0,0 +1,122 @@
+/*
+Quicklight raycaster-like renderer - Out-of-core scenes
+
+Copyright (c) 2020 Amélia O. F. da S.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef QLCHUNK
+#define QLCHUNK
+
+#include <stddef.h>
+#include <pthread.h>
+#include "./quicklight.h"
+
+/*
+Scenes too large to be kept in memory are stored as chunks: the triangles are grouped by the cell of a grid their
+centroid falls in, and a header lists the bounds of every chunk and where its triangles are in the file.
+Chunks are loaded by a background thread as the camera approaches or looks at them, and dropped when they're no
+longer needed and the memory budget is full. Rendering only ever sees the chunks that are already loaded.
+
+File layout (little-endian):
+"QLCHUNK1", number of chunks (uint32)
+For each chunk: minimum and maximum corners of its bounds (6 float32), offset of its triangles in the file (uint64),
+number of triangles (uint32), reserved (uint32)
+The chunks' triangles: three vertices (9 float32), colour (3 bytes) and a padding byte for each
+*/
+
+/*Chunk states*/
+#define QL_CHUNK_OUT 0 /*Not in memory*/
+#define QL_CHUNK_QUEUED 1 /*Waiting to be loaded*/
+#define QL_CHUNK_LOADING 2 /*Being read by the loader thread*/
+#define QL_CHUNK_IN 3 /*In memory*/
+#define QL_CHUNK_FAILED 4 /*Couldn't be read (it won't be requested again)*/
+
+/*A chunk of an out-of-core scene*/
+typedef struct _qlchunk{
+    qlvect min;/*Lower corner of the chunk's bounds*/
+    qlvect max;/*Upper corner of the chunk's bounds*/
+    qlvect center;/*Centre of the bounds*/
+    double radius;/*Radius of the sphere around the bounds*/
+    long long offset;/*Position of the chunk's triangles in the file*/
+    int ntris;/*Number of triangles*/
+    size_t bytes;/*Memory the chunk takes when loaded*/
+    qltri *tris;/*The chunk's triangles, while it is loaded*/
+    char state;/*QL_CHUNK_**/
+} qlchunk;
+
+/*Priority of a chunk in the last qlchunksupdate (lower keys load first)*/
+typedef struct _qlchunkkey{
+    double key;
+    int chunk;
+} qlchunkkey;
+
+/*
+An out-of-core scene, read from a chunk file.
+Everything but the loaded triangles is shared with the loader thread and only accessed with lock held.
+*/
+typedef struct _qlchunks{
+    int fd;/*The chunk file*/
+    int n;/*Number of chunks*/
+    qlchunk *chunks;/*Chunks, in file order*/
+    size_t budget;/*Memory for loaded triangles, in bytes. It may be exceeded by the one chunk being loaded*/
+    size_t resident;/*Memory taken by the loaded chunks and the ones waiting to be*/
+    double prefetch;/*Chunks closer than this to the camera are loaded even when out of view (defaults to 0)*/
+    const qltri **list;/*Triangles of the loaded chunks in view (NULL-terminated)*/
+    int listcap;/*Room in list*/
+    qlchunkkey *order;/*Chunks wanted by the last update, most important first*/
+    int *queue;/*Chunks to be loaded, most important first*/
+    int queued;/*Length of the queue*/
+    int next;/*Position of the next chunk the loader thread will take from the queue*/
+    char busy;/*Whether the loader thread is reading a chunk*/
+    int missing;/*Chunks in view that weren't loaded yet at the last update (and so were skipped)*/
+    unsigned long long loads;/*Chunks loaded so far*/
+    unsigned long long evictions;/*Chunks dropped so far*/
+    pthread_t thread;/*Loader thread*/
+    pthread_mutex_t lock;
+    pthread_cond_t work;/*Signalled when the queue changes*/
+    pthread_cond_t idle;/*Signalled when the loader thread runs out of work*/
+    char quit;
+} qlchunks;
+
+/*
+Writes the NULL-terminated list of triangles to a chunk file, grouping them into cubic cells of side <size>.
+Vertices are stored in single precision.
+Returns the number of chunks, or -1 if the file couldn't be written.
+*/
+int qlchunkwrite(const char *fname,const qltri **tris,double size);
+/*
+Opens a chunk file with a memory budget of <budget> bytes for loaded triangles, and starts its loader thread.
+Returns NULL if the file can't be read. One should free it with freeqlchunks.
+*/
+qlchunks *Qlchunks(const char *fname,size_t budget);
+/*
+Prioritizes the chunks for the camera: the ones in view come first, nearest first, then the ones within prefetch
+of the camera. Chunks that no longer fit in the budget are dropped and the missing ones are queued for loading.
+Returns the NULL-terminated list of the triangles of the loaded chunks in view, which stays valid (and can be
+traced) until the next call. Never waits for the loader thread.
+*/
+const qltri **qlchunksupdate(qlchunks *chunks,const qlcamera *camera);
+/*Waits until the loader thread has loaded every chunk queued by the last qlchunksupdate*/
+void qlchunkswait(qlchunks *chunks);
+/*Stops the loader thread and frees a qlchunks object*/
+void freeqlchunks(qlchunks **chunks);
+
+#endif
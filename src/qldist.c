@@ -0,0 +1,367 @@
+#include "./qldist.h"
+#include "./qlstream.h"
+#include "./qlscene.h"
+#include "./qlstats.h"
+#include "./qlvect.h"
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+/*
+Copyright (c) 2020 Amélia O. F. da S.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#define QL_DIST_REQUEST (4+6*4+11*8)
+#define QL_DIST_ANSWER (4+5*4)
+
+static void qldistput32(unsigned char *p,unsigned int v)
+{
+    p[0]=v;
+    p[1]=v>>8;
+    p[2]=v>>16;
+    p[3]=v>>24;
+}
+static unsigned int qldistget32(const unsigned char *p)
+{
+    return p[0]|(p[1]<<8)|(p[2]<<16)|((unsigned int)p[3]<<24);
+}
+static void qldistputdouble(unsigned char *p,double d)
+{
+    unsigned long long v;
+    memcpy(&v,&d,sizeof(v));
+    qldistput32(p,v);
+    qldistput32(p+4,v>>32);
+}
+static double qldistgetdouble(const unsigned char *p)
+{
+    double d;
+    unsigned long long v=qldistget32(p)|((unsigned long long)qldistget32(p+4)<<32);
+    memcpy(&d,&v,sizeof(d));
+    return d;
+}
+/*Makes sure buf holds at least size bytes*/
+static unsigned char *qldistbuffer(unsigned char **buf,size_t *bufsize,size_t size)
+{
+    if(size>*bufsize)
+    {
+        free(*buf);
+        *buf=malloc(size);
+        *bufsize=*buf?size:0;
+    }
+    return *buf;
+}
+
+qldist *Qldist(const char *addr)
+{
+    qldist *ret;
+    int fd=qlstreamsocket(addr,1);
+    if(fd<0)return NULL;
+    ret=malloc(sizeof(qldist));
+    ret->fd=fd;
+    ret->n=0;
+    ret->timeout=QL_DIST_TIMEOUT;
+    ret->rowcost=NULL;
+    ret->h=0;
+    ret->frame=0;
+    ret->buf=NULL;
+    ret->bufsize=0;
+    return ret;
+}
+
+/*Makes receiving from a socket fail (as qlrecvall does on errors) after ms milliseconds without data*/
+static void qldistsettimeout(int fd,int ms)
+{
+    struct timeval t;
+    t.tv_sec=ms/1000;
+    t.tv_usec=(ms%1000)*1000;
+    setsockopt(fd,SOL_SOCKET,SO_RCVTIMEO,&t,sizeof(t));
+}
+
+int qldistaccept(qldist *dist,int n)
+{
+    int fd;
+    if(!dist)return -1;
+    if(n>QL_DIST_WORKERS)n=QL_DIST_WORKERS;
+    while(dist->n<n)
+    {
+        fd=accept(dist->fd,NULL,NULL);
+        if(fd<0&&errno==EINTR)continue;
+        if(fd<0)return -1;
+        dist->workers[dist->n]=fd;
+        dist->ns[dist->n]=0;
+        dist->n++;
+        qldistsettimeout(fd,dist->timeout);
+    }
+    return dist->n;
+}
+
+void qldisttimeout(qldist *dist,int ms)
+{
+    int i;
+    if(!dist||ms<0)return;
+    dist->timeout=ms;
+    for(i=0;i<dist->n;i++)qldistsettimeout(dist->workers[i],ms);
+}
+
+/*Splits rows [0,h) into dist->n bands of about the same estimated cost, of at least one row each (where there are enough rows)*/
+static void qldistbands(qldist *dist,int h)
+{
+    int k,y=0,n=dist->n;
+    double total=0,acc=0;
+    for(k=0;k<h;k++)total+=dist->rowcost[k];
+    dist->band[0]=0;
+    for(k=1;k<n;k++)
+    {
+        /*Cuts at the row boundary nearest to the k-th share of the cost*/
+        while(y<h-(n-k)&&(y<dist->band[k-1]+1||acc+dist->rowcost[y]/2<total*k/n))acc+=dist->rowcost[y++];
+        dist->band[k]=y;
+    }
+    dist->band[n]=h;
+}
+
+/*Blends a band's measured cost per row into the estimates*/
+static void qldistcost(qldist *dist,int y0,int y1,unsigned long long ns,char first)
+{
+    int y;
+    double cost;
+    if(y1<=y0)return;
+    cost=(double)ns/(y1-y0);
+    /*Rows never cost nothing, or the bands around them would grow without bound*/
+    if(cost<1)cost=1;
+    for(y=y0;y<y1;y++)dist->rowcost[y]=first?cost:(dist->rowcost[y]+cost)/2;
+}
+
+/*Receives worker i's answer into the camera's raster. Returns 0 on success and -1 on errors.*/
+static int qldistgather(qldist *dist,int i,qlcamera *camera)
+{
+    qlraster *image=camera->image;
+    unsigned char header[QL_DIST_ANSWER];
+    int y0=dist->band[i],y1=dist->band[i+1];
+    unsigned int a0,a1;
+    size_t k,pixels=(size_t)(y1-y0)*image->w;
+    if(qlrecvall(dist->workers[i],header,QL_DIST_ANSWER))return -1;
+    if(memcmp(header,"QLDA",4)||qldistget32(header+4)!=dist->frame)return -1;
+    /*The band is checked against the image before it's compared with the one asked for*/
+    a0=qldistget32(header+8);
+    a1=qldistget32(header+12);
+    if(a0>(unsigned int)image->h||a1>(unsigned int)image->h||(int)a0!=y0||(int)a1!=y1)return -1;
+    dist->ns[i]=qldistget32(header+16)|((unsigned long long)qldistget32(header+20)<<32);
+    if(qlrecvall(dist->workers[i],image->data+(size_t)y0*image->w*image->s,pixels*image->s))return -1;
+    if(!qldistbuffer(&dist->buf,&dist->bufsize,pixels*8))return -1;
+    if(qlrecvall(dist->workers[i],dist->buf,pixels*8))return -1;
+    for(k=0;k<pixels;k++)image->z[(size_t)y0*image->w+k]=qldistgetdouble(dist->buf+k*8);
+    return 0;
+}
+
+int qldistrender(qldist *dist,qlcamera *camera,const qltri **tris)
+{
+    qlraster *image;
+    unsigned char request[QL_DIST_REQUEST];
+    char failed[QL_DIST_WORKERS],first=0,lost=0;
+    int i,n;
+    unsigned long long t;
+    if(!dist||!camera)return -1;
+    image=camera->image;
+    if(dist->h!=image->h)
+    {
+        free(dist->rowcost);
+        dist->rowcost=malloc(sizeof(double)*image->h);
+        for(i=0;i<image->h;i++)dist->rowcost[i]=1;
+        dist->h=image->h;
+        first=1;
+    }
+    if(!dist->n)
+    {
+        if(!tris)return -1;
+        qltracerows(camera,tris,0,image->h);
+        qlshade(camera);
+        return 0;
+    }
+    qldistbands(dist,image->h);
+    dist->frame++;
+
+    memcpy(request,"QLDR",4);
+    qldistput32(request+4,dist->frame);
+    qldistput32(request+8,image->w);
+    qldistput32(request+12,image->h);
+    qldistput32(request+16,image->fmt);
+    qldistputdouble(request+28,camera->pos.x);
+    qldistputdouble(request+36,camera->pos.y);
+    qldistputdouble(request+44,camera->pos.z);
+    qldistputdouble(request+52,camera->dir.x);
+    qldistputdouble(request+60,camera->dir.y);
+    qldistputdouble(request+68,camera->dir.z);
+    qldistputdouble(request+76,camera->roll);
+    qldistputdouble(request+84,camera->fl);
+    qldistputdouble(request+92,camera->w);
+    qldistputdouble(request+100,camera->h);
+    qldistputdouble(request+108,camera->depth);
+    /*Every worker gets its request before any answer is waited for, so that they all trace at once*/
+    for(i=0;i<dist->n;i++)
+    {
+        qldistput32(request+20,dist->band[i]);
+        qldistput32(request+24,dist->band[i+1]);
+        failed[i]=qlsendall(dist->workers[i],request,QL_DIST_REQUEST)!=0;
+    }
+    for(i=0;i<dist->n;i++)
+    {
+        if(!failed[i])failed[i]=qldistgather(dist,i,camera)!=0;
+        if(failed[i])
+        {
+            /*The worker's rows are traced here instead, and timed the same way*/
+            if(!tris)
+            {
+                lost=1;
+                continue;
+            }
+            t=qlstatsnow();
+            qltracerows(camera,tris,dist->band[i],dist->band[i+1]);
+            dist->ns[i]=qlstatsnow()-t;
+        }
+        qldistcost(dist,dist->band[i],dist->band[i+1],dist->ns[i],first);
+    }
+
+    /*Drops the workers that failed*/
+    for(i=0,n=0;i<dist->n;i++)
+    {
+        if(failed[i])
+        {
+            close(dist->workers[i]);
+            continue;
+        }
+        dist->workers[n]=dist->workers[i];
+        dist->ns[n]=dist->ns[i];
+        n++;
+    }
+    /*With workers dropped, the bands are those the next frame will be split into*/
+    if(n<dist->n)
+    {
+        dist->n=n;
+        if(n)qldistbands(dist,image->h);
+    }
+    if(lost)return -1;
+    qlshade(camera);
+    return dist->n;
+}
+
+void freeqldist(qldist **dist)
+{
+    int i;
+    if(!dist||!(*dist))return;
+    for(i=0;i<(*dist)->n;i++)
+    {
+        qlsendall((*dist)->workers[i],(const unsigned char*)"QLDQ",4);
+        close((*dist)->workers[i]);
+    }
+    close((*dist)->fd);
+    free((*dist)->rowcost);
+    free((*dist)->buf);
+    free(*dist);
+    *dist=NULL;
+}
+
+int qldistworker(const char *addr,qltri **tris)
+{
+    unsigned char request[QL_DIST_REQUEST],header[QL_DIST_ANSWER],*buf=NULL;
+    size_t bufsize=0,pixels,k;
+    int i,w,h,fmt,y0,y1,ret=-1;
+    unsigned long long t;
+    qlvect pos,dir;
+    qlraster *raster=NULL;
+    qlcamera *camera=NULL;
+    qlscene *scene;
+    const qltri **visible;
+    int fd=qlstreamsocket(addr,0);
+    if(fd<0)return -1;
+    for(i=0;tris[i];i++);
+    scene=Qlscene(tris);
+    visible=malloc(sizeof(qltri*)*(i+1));
+    while(!qlrecvall(fd,request,4))
+    {
+        if(!memcmp(request,"QLDQ",4))
+        {
+            ret=0;
+            break;
+        }
+        if(memcmp(request,"QLDR",4)||qlrecvall(fd,request+4,QL_DIST_REQUEST-4))break;
+        w=qldistget32(request+8);
+        h=qldistget32(request+12);
+        fmt=qldistget32(request+16);
+        y0=qldistget32(request+20);
+        y1=qldistget32(request+24);
+        if(w<=0||h<=0||y0<0||y1>h||y0>y1)break;
+        if(fmt!=QL_RGB24&&fmt!=QL_XRGB32&&fmt!=QL_XBGR32)break;
+        pos=qlv(qldistgetdouble(request+28),qldistgetdouble(request+36),qldistgetdouble(request+44));
+        dir=qlv(qldistgetdouble(request+52),qldistgetdouble(request+60),qldistgetdouble(request+68));
+        if(!raster||raster->w!=w||raster->h!=h)
+        {
+            freeqlcamera(&camera);
+            freeqlraster(&raster);
+            raster=Qlraster(w,h,3);
+            camera=Qlcamera(raster,&pos,&dir,0,1,1,1,1);
+        }
+        if(raster->fmt!=fmt)qlrastersetformat(raster,fmt);
+        /*The state is copied as is (Qlcamera would normalize dir), so the rays are the coordinator's*/
+        camera->pos=pos;
+        camera->dir=dir;
+        camera->roll=qldistgetdouble(request+76);
+        camera->fl=qldistgetdouble(request+84);
+        camera->w=qldistgetdouble(request+92);
+        camera->h=qldistgetdouble(request+100);
+        camera->depth=qldistgetdouble(request+108);
+        qlupdatecamera(camera);
+
+        t=qlstatsnow();
+        qlscenecull(scene,camera,visible);
+        qltracerows(camera,visible,y0,y1);
+        t=qlstatsnow()-t;
+
+        pixels=(size_t)(y1-y0)*w;
+        if(!qldistbuffer(&buf,&bufsize,pixels*8))break;
+        memcpy(header,"QLDA",4);
+        memcpy(header+4,request+4,4);
+        qldistput32(header+8,y0);
+        qldistput32(header+12,y1);
+        qldistput32(header+16,t);
+        qldistput32(header+20,t>>32);
+        for(k=0;k<pixels;k++)qldistputdouble(buf+k*8,raster->z[(size_t)y0*w+k]);
+        if(qlsendall(fd,header,QL_DIST_ANSWER)||
+            qlsendall(fd,raster->data+(size_t)y0*w*raster->s,pixels*raster->s)||
+            qlsendall(fd,buf,pixels*8))break;
+    }
+    close(fd);
+    free(buf);
+    free(visible);
+    freeqlscene(&scene);
+    freeqlcamera(&camera);
+    freeqlraster(&raster);
+    return ret;
+}
+
+pid_t qldistspawn(const char *addr,qltri **tris)
+{
+    pid_t pid=fork();
+    /*_exit, so that the child doesn't flush the parent's stdio buffers again*/
+    if(!pid)_exit(qldistworker(addr,tris)?1:0);
+    return pid;
+}
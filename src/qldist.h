@@ -0,0 +1,93 @@
+/*
+Quicklight raycaster-like renderer - Distributed rendering
+
+Copyright (c) 2020 Amélia O. F. da S.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef QLDIST
+#define QLDIST
+
+#include <sys/types.h>
+#include "./quicklight.h"
+
+/*
+Distributed rendering: a coordinator splits each frame into bands of rows and has worker processes trace them.
+Each worker holds its own copy of the scene. The coordinator sends it the camera's state and the rows to trace,
+and gets back the unshaded colours and the depth of those rows, which it gathers into the camera's raster and
+shades itself (so the result is the same as qlstep's).
+Bands are resized every frame so that the rows' measured cost is split evenly between the workers.
+
+Wire format (integers are little-endian uint32, doubles are sent as their little-endian 64-bit pattern):
+    request: "QLDR" frame w h fmt y0 y1, followed by the camera's pos, dir, roll, fl, w, h and depth (11 doubles)
+    answer:  "QLDA" frame y0 y1 ns (as two uint32, low first), followed by the rows' pixels and their depth
+    quit:    "QLDQ"
+*/
+
+/*Maximum number of workers of a coordinator*/
+#define QL_DIST_WORKERS 16
+/*Default time a coordinator waits for a worker's answer before dropping it, in milliseconds*/
+#define QL_DIST_TIMEOUT 10000
+
+/*A distributed rendering coordinator*/
+typedef struct _qldist{
+    int fd;/*Listening socket*/
+    int n;/*Number of connected workers*/
+    int workers[QL_DIST_WORKERS];/*Sockets of the connected workers*/
+    int band[QL_DIST_WORKERS+1];/*Worker i traced rows [band[i],band[i+1]) of the last frame (or will, if workers were dropped)*/
+    unsigned long long ns[QL_DIST_WORKERS];/*Time worker i spent tracing its band of the last frame*/
+    int timeout;/*Time to wait for data from a worker before dropping it, in milliseconds (0 waits forever). Change it with qldisttimeout*/
+    double *rowcost;/*Estimated time each row takes to trace, in nanoseconds*/
+    int h;/*Number of rows rowcost has*/
+    unsigned int frame;/*Frame counter*/
+    unsigned char *buf;/*Receiving buffer*/
+    size_t bufsize;/*Size of buf*/
+} qldist;
+/*
+Opens a coordinator listening at addr ("unix:<path>" or "tcp:<port>", as Qlstream).
+Returns NULL on errors. One should close it with freeqldist, which also stops the workers.
+*/
+qldist *Qldist(const char *addr);
+/*Waits until n workers are connected. Returns the number of connected workers, or -1 on errors.*/
+int qldistaccept(qldist *dist,int n);
+/*
+Sets how long the coordinator waits for data from a worker before dropping it, as a failed one
+(so a worker that hangs without closing its connection doesn't stall the frame). ms=0 waits forever.
+*/
+void qldisttimeout(qldist *dist,int ms);
+/*
+Renders a frame of the camera (which must be up to date) on the workers, and shades it.
+Workers that fail or time out are dropped, and their rows traced locally with the triangles given (if not NULL).
+Returns the number of workers left, or -1 if no rows could be traced.
+*/
+int qldistrender(qldist *dist,qlcamera *camera,const qltri **tris);
+/*Stops the workers and closes a coordinator*/
+void freeqldist(qldist **dist);
+
+/*
+Runs a worker: connects to the coordinator at addr (as Qlstreamclient) and traces the rows it asks for
+with the NULL-terminated list of triangles tris, until it is told to quit.
+Returns 0 when told to quit and -1 on errors.
+*/
+int qldistworker(const char *addr,qltri **tris);
+/*Forks a process running qldistworker (which exits when it returns). Returns its pid, or -1 on errors.*/
+pid_t qldistspawn(const char *addr,qltri **tris);
+
+#endif
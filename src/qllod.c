@@ -0,0 +1,660 @@
+#include "./qllod.h"
+#include "./qlscene.h"
+#include "./qlvect.h"
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+/*
+Copyright (c) 2020 Amélia O. F. da S.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/*State of a mesh being simplified*/
+typedef struct _qllodwork{
+    int nv;/*Number of vertices*/
+    int nt;/*Number of triangles*/
+    qlvect *pos;/*Vertex positions*/
+    double *q;/*Quadric of each vertex (10 coefficients, see qllodquadric)*/
+    unsigned int *into;/*Vertex each vertex was merged into (itself if it wasn't)*/
+    const qlvect *orig;/*Original vertex positions*/
+    char *locked;/*Vertices on an open border, which never move*/
+    char *touched;/*Vertices changed by the current pass*/
+    int *mark;/*Scratch stamps for neighbour sets*/
+    int stamp;/*Last stamp used*/
+    unsigned int *idx;/*Vertex indices of each triangle*/
+    const unsigned char *colours;/*Triangle colours*/
+    char *alive;/*Triangles not collapsed yet*/
+    int alivecount;/*Number of triangles alive*/
+    int *adjstart;/*Triangles around vertex v are adj[adjstart[v]] to adj[adjstart[v+1]-1] (as of the start of the pass)*/
+    int *adj;
+} qllodwork;
+
+/*An edge, in the order edges are collapsed*/
+typedef struct _qllodedge{
+    double cost;
+    unsigned int u,v;
+} qllodedge;
+
+static int qllodedgecmp(const void *a,const void *b)
+{
+    const qllodedge *x=a,*y=b;
+    if(x->cost!=y->cost)return x->cost<y->cost?-1:1;
+    if(x->u!=y->u)return x->u<y->u?-1:1;
+    return x->v<y->v?-1:x->v>y->v;
+}
+
+/*
+Adds the plane of triangle abc to quadric q: the sum of squared distances to it, as the coefficients of
+a²x²+2abxy+2acxz+2adx+b²y²+2bcyz+2bdy+c²z²+2cdz+d² (plane ax+by+cz+d=0, with a unit normal)
+*/
+static void qllodquadric(double *q,qlvect a,qlvect b,qlvect c)
+{
+    qlvect n=qlvcross(qlvsub(b,a),qlvsub(c,a));
+    double len=sqrt(qlvdot(n,n)),d;
+    if(len==0)return;
+    n=qlvscale(n,1/len);
+    d=-qlvdot(n,a);
+    q[0]+=n.x*n.x;q[1]+=n.x*n.y;q[2]+=n.x*n.z;q[3]+=n.x*d;
+    q[4]+=n.y*n.y;q[5]+=n.y*n.z;q[6]+=n.y*d;
+    q[7]+=n.z*n.z;q[8]+=n.z*d;
+    q[9]+=d*d;
+}
+/*Error of the sum of two quadrics at p, as a distance*/
+static double qllodqerror(const double *q,const double *r,qlvect p)
+{
+    double s[10],e;
+    int i;
+    for(i=0;i<10;i++)s[i]=q[i]+r[i];
+    e=s[0]*p.x*p.x+2*s[1]*p.x*p.y+2*s[2]*p.x*p.z+2*s[3]*p.x+s[4]*p.y*p.y+2*s[5]*p.y*p.z+2*s[6]*p.y+
+        s[7]*p.z*p.z+2*s[8]*p.z+s[9];
+    return e>0?sqrt(e):0;
+}
+
+/*Locks the vertices of edges that don't have exactly two triangles (open borders and non-manifold edges)*/
+static void qllodlockborders(qllodwork *w)
+{
+    qllodedge *edges=malloc(sizeof(qllodedge)*3*w->nt);
+    int i,j,k;
+    unsigned int u,v;
+    for(i=0;i<w->nt;i++)
+        for(k=0;k<3;k++)
+        {
+            u=w->idx[i*3+k];
+            v=w->idx[i*3+(k+1)%3];
+            edges[i*3+k].u=u<v?u:v;
+            edges[i*3+k].v=u<v?v:u;
+            edges[i*3+k].cost=0;
+        }
+    qsort(edges,3*w->nt,sizeof(qllodedge),qllodedgecmp);
+    for(i=0;i<3*w->nt;i=j)
+    {
+        for(j=i;j<3*w->nt&&edges[j].u==edges[i].u&&edges[j].v==edges[i].v;j++){}
+        if(j-i!=2)w->locked[edges[i].u]=w->locked[edges[i].v]=1;
+    }
+    free(edges);
+}
+
+/*Rebuilds the lists of triangles around each vertex*/
+static void qllodadjacency(qllodwork *w)
+{
+    int i,k,v;
+    memset(w->adjstart,0,sizeof(int)*(w->nv+1));
+    for(i=0;i<w->nt;i++)
+        if(w->alive[i])
+            for(k=0;k<3;k++)w->adjstart[w->idx[i*3+k]+1]++;
+    for(v=0;v<w->nv;v++)w->adjstart[v+1]+=w->adjstart[v];
+    /*mark is used as the insertion cursor of each vertex*/
+    memcpy(w->mark,w->adjstart,sizeof(int)*w->nv);
+    for(i=0;i<w->nt;i++)
+        if(w->alive[i])
+            for(k=0;k<3;k++)w->adj[w->mark[w->idx[i*3+k]]++]=i;
+    memset(w->mark,0,sizeof(int)*w->nv);
+    w->stamp=0;
+}
+
+/*
+Where the edge uv collapses to, and the error there.
+The new vertex goes to the locked end if there is one, or else to whichever of the ends and the midpoint has the least error.
+*/
+static double qllodtarget(const qllodwork *w,unsigned int u,unsigned int v,qlvect *p)
+{
+    const double *qu=&w->q[u*10],*qv=&w->q[v*10];
+    qlvect mid;
+    double e,best;
+    if(w->locked[u]||w->locked[v])
+    {
+        *p=w->locked[u]?w->pos[u]:w->pos[v];
+        return qllodqerror(qu,qv,*p);
+    }
+    *p=w->pos[u];
+    best=qllodqerror(qu,qv,*p);
+    if((e=qllodqerror(qu,qv,w->pos[v]))<best)
+    {
+        *p=w->pos[v];
+        best=e;
+    }
+    mid=qlvscale(qlvsum(w->pos[u],w->pos[v]),0.5);
+    if((e=qllodqerror(qu,qv,mid))<best)
+    {
+        *p=mid;
+        best=e;
+    }
+    return best;
+}
+
+/*
+Whether collapsing uv keeps the mesh manifold: the vertices around both u and v must be exactly the ones
+opposite to uv in the triangles that share it.
+*/
+static char qllodlink(qllodwork *w,unsigned int u,unsigned int v)
+{
+    int i,k,t,shared=0,common=0;
+    unsigned int x;
+    int around=++w->stamp,counted=++w->stamp;
+    for(i=w->adjstart[u];i<w->adjstart[u+1];i++)
+    {
+        t=w->adj[i];
+        if(!w->alive[t])continue;
+        for(k=0;k<3;k++)
+        {
+            x=w->idx[t*3+k];
+            if(x==v)shared++;
+            if(x!=u)w->mark[x]=around;
+        }
+    }
+    for(i=w->adjstart[v];i<w->adjstart[v+1];i++)
+    {
+        t=w->adj[i];
+        if(!w->alive[t])continue;
+        for(k=0;k<3;k++)
+        {
+            x=w->idx[t*3+k];
+            if(x!=v&&x!=u&&w->mark[x]==around)
+            {
+                w->mark[x]=counted;
+                common++;
+            }
+        }
+    }
+    return common==shared;
+}
+
+/*Whether moving u and v to p flips any of the triangles around them that survive the collapse*/
+static char qllodflips(const qllodwork *w,unsigned int u,unsigned int v,qlvect p)
+{
+    int i,k,t,e;
+    unsigned int ends[2]={u,v},x;
+    qlvect q[3],before,after;
+    for(e=0;e<2;e++)
+        for(i=w->adjstart[ends[e]];i<w->adjstart[ends[e]+1];i++)
+        {
+            t=w->adj[i];
+            if(!w->alive[t])continue;
+            for(k=0;k<3;k++)
+            {
+                x=w->idx[t*3+k];
+                if(x==ends[1-e])break;
+                q[k]=w->pos[x];
+            }
+            /*Triangles on the edge itself disappear*/
+            if(k<3)continue;
+            before=qlvcross(qlvsub(q[1],q[0]),qlvsub(q[2],q[0]));
+            for(k=0;k<3;k++)if(w->idx[t*3+k]==ends[e])q[k]=p;
+            after=qlvcross(qlvsub(q[1],q[0]),qlvsub(q[2],q[0]));
+            if(qlvdot(before,after)<=0&&qlvdot(before,before)>0)return 1;
+        }
+    return 0;
+}
+
+/*Collapses the edge uv into p*/
+static void qllodcollapse(qllodwork *w,unsigned int u,unsigned int v,qlvect p)
+{
+    int i,k,t;
+    unsigned int keep=w->locked[u]?u:v,gone=keep==u?v:u,*tri;
+    w->pos[keep]=p;
+    w->into[gone]=keep;
+    for(i=0;i<10;i++)w->q[keep*10+i]+=w->q[gone*10+i];
+    for(i=w->adjstart[gone];i<w->adjstart[gone+1];i++)
+    {
+        t=w->adj[i];
+        if(!w->alive[t])continue;
+        tri=&w->idx[t*3];
+        for(k=0;k<3;k++)if(tri[k]==gone)tri[k]=keep;
+        if(tri[0]==tri[1]||tri[1]==tri[2]||tri[2]==tri[0])
+        {
+            w->alive[t]=0;
+            w->alivecount--;
+        }
+    }
+    w->touched[u]=w->touched[v]=1;
+}
+
+/*
+Collapses edges, cheapest first, until target triangles are left or every edge has been tried.
+Each vertex takes part in one collapse per pass at most. Returns the number of collapses.
+*/
+static int qllodpass(qllodwork *w,int target)
+{
+    qllodedge *edges=malloc(sizeof(qllodedge)*(3*w->alivecount+1));
+    int i,k,n=0,collapsed=0;
+    unsigned int u,v;
+    qlvect p;
+    qllodadjacency(w);
+    for(i=0;i<w->nt;i++)
+    {
+        if(!w->alive[i])continue;
+        for(k=0;k<3;k++)
+        {
+            u=w->idx[i*3+k];
+            v=w->idx[i*3+(k+1)%3];
+            if(w->locked[u]&&w->locked[v])continue;
+            edges[n].u=u<v?u:v;
+            edges[n].v=u<v?v:u;
+            edges[n++].cost=qllodtarget(w,u,v,&p);
+        }
+    }
+    qsort(edges,n,sizeof(qllodedge),qllodedgecmp);
+    memset(w->touched,0,w->nv);
+    for(i=0;i<n&&w->alivecount>target;i++)
+    {
+        u=edges[i].u;
+        v=edges[i].v;
+        /*Also skips the second copy of every edge*/
+        if(w->touched[u]||w->touched[v])continue;
+        qllodtarget(w,u,v,&p);
+        if(!qllodlink(w,u,v)||qllodflips(w,u,v,p))continue;
+        qllodcollapse(w,u,v,p);
+        collapsed++;
+    }
+    free(edges);
+    return collapsed;
+}
+
+/*Distance from p to triangle abc*/
+static double qlloddistance(qlvect p,qlvect a,qlvect b,qlvect c)
+{
+    qlvect n=qlvcross(qlvsub(b,a),qlvsub(c,a)),ends[4]={a,b,c,a},e,d;
+    double t,dist,best=INFINITY,len=qlvdot(n,n);
+    int i;
+    if(len>0)
+    {
+        /*Projected inside the triangle: the distance to its plane*/
+        t=qlvdot(qlvsub(p,a),n)/len;
+        if(qlvintri(qlvsub(p,qlvscale(n,t)),a,b,c))return fabs(t)*sqrt(len);
+    }
+    /*Otherwise, the distance to the nearest edge*/
+    for(i=0;i<3;i++)
+    {
+        e=qlvsub(ends[i+1],ends[i]);
+        len=qlvdot(e,e);
+        t=len>0?qlvdot(qlvsub(p,ends[i]),e)/len:0;
+        t=t<0?0:t>1?1:t;
+        d=qlvsub(p,qlvsum(ends[i],qlvscale(e,t)));
+        dist=qlvdot(d,d);
+        if(dist<best)best=dist;
+    }
+    return sqrt(best);
+}
+
+/*
+The error of the mesh as simplified so far: the largest distance from a vertex of the original mesh to the
+triangles near the vertex it was merged into (those that share a vertex with a triangle around it)
+*/
+static double qlloderror(qllodwork *w)
+{
+    double error=0,dist,best;
+    unsigned int v,s,x;
+    int i,j,k,u;
+    qllodadjacency(w);
+    for(v=0;v<(unsigned int)w->nv;v++)
+    {
+        for(s=v;w->into[s]!=s;s=w->into[s]){}
+        /*Shortens the chains for the next levels*/
+        w->into[v]=s;
+        best=INFINITY;
+        for(i=w->adjstart[s];i<w->adjstart[s+1];i++)
+            for(k=0;k<3;k++)
+            {
+                x=w->idx[w->adj[i]*3+k];
+                for(j=w->adjstart[x];j<w->adjstart[x+1];j++)
+                {
+                    u=w->adj[j];
+                    dist=qlloddistance(w->orig[v],w->pos[w->idx[u*3]],w->pos[w->idx[u*3+1]],w->pos[w->idx[u*3+2]]);
+                    if(dist<best)best=dist;
+                }
+            }
+        if(best<INFINITY&&best>error)error=best;
+    }
+    return error;
+}
+
+/*Copies the triangles alive into a new mesh*/
+static qlmesh *qllodmesh(qllodwork *w)
+{
+    qlmesh *ret=Qlmesh(w->nv,w->alivecount);
+    int i,k;
+    unsigned int tri[3],x;
+    /*mark maps the work's vertices to the mesh's*/
+    for(i=0;i<w->nv;i++)w->mark[i]=-1;
+    for(i=0;i<w->nt;i++)
+    {
+        if(!w->alive[i])continue;
+        for(k=0;k<3;k++)
+        {
+            x=w->idx[i*3+k];
+            if(w->mark[x]<0)w->mark[x]=qlmeshvert(ret,&w->pos[x]);
+            tri[k]=w->mark[x];
+        }
+        qlmeshtri(ret,tri[0],tri[1],tri[2],&w->colours[i*3]);
+    }
+    return ret;
+}
+
+/*The triangles of a mesh as an array of qltri*/
+static qltri *qllodtris(const qlmesh *mesh)
+{
+    qltri *ret=malloc(sizeof(qltri)*(mesh->ntris+1));
+    int i;
+    for(i=0;i<mesh->ntris;i++)
+    {
+        ret[i].a=mesh->verts[mesh->idx[i*3]];
+        ret[i].b=mesh->verts[mesh->idx[i*3+1]];
+        ret[i].c=mesh->verts[mesh->idx[i*3+2]];
+        memcpy(ret[i].colour,&mesh->colours[i*3],3);
+    }
+    return ret;
+}
+
+qllod *Qllod(const qlmesh *mesh,int maxlevels)
+{
+    qllod *ret;
+    qllodwork w;
+    qlvect min,max;
+    int i,k,prev;
+    if(!mesh||mesh->ntris<=0)return NULL;
+    if(maxlevels<1)maxlevels=1;
+    if(maxlevels>QL_LOD_LEVELS)maxlevels=QL_LOD_LEVELS;
+    w.nv=mesh->nverts;
+    w.nt=mesh->ntris;
+    w.pos=malloc(sizeof(qlvect)*w.nv);
+    memcpy(w.pos,mesh->verts,sizeof(qlvect)*w.nv);
+    w.q=calloc(w.nv*10,sizeof(double));
+    w.into=malloc(sizeof(unsigned int)*w.nv);
+    for(i=0;i<w.nv;i++)w.into[i]=i;
+    w.orig=mesh->verts;
+    w.locked=calloc(w.nv,1);
+    w.touched=calloc(w.nv,1);
+    w.mark=calloc(w.nv,sizeof(int));
+    w.idx=malloc(sizeof(unsigned int)*3*w.nt);
+    memcpy(w.idx,mesh->idx,sizeof(unsigned int)*3*w.nt);
+    w.colours=mesh->colours;
+    w.alive=malloc(w.nt);
+    memset(w.alive,1,w.nt);
+    w.alivecount=w.nt;
+    w.adjstart=malloc(sizeof(int)*(w.nv+1));
+    w.adj=malloc(sizeof(int)*3*w.nt);
+    for(i=0;i<w.nt;i++)
+        for(k=0;k<3;k++)
+            qllodquadric(&w.q[w.idx[i*3+k]*10],w.pos[w.idx[i*3]],w.pos[w.idx[i*3+1]],w.pos[w.idx[i*3+2]]);
+    qllodlockborders(&w);
+
+    ret=malloc(sizeof(qllod));
+    ret->levels[0]=qllodmesh(&w);
+    ret->error[0]=0;
+    ret->tris[0]=qllodtris(ret->levels[0]);
+    ret->nlevels=1;
+    min=max=ret->levels[0]->verts[0];
+    for(i=1;i<ret->levels[0]->nverts;i++)
+    {
+        min=qlv(fmin(min.x,ret->levels[0]->verts[i].x),fmin(min.y,ret->levels[0]->verts[i].y),fmin(min.z,ret->levels[0]->verts[i].z));
+        max=qlv(fmax(max.x,ret->levels[0]->verts[i].x),fmax(max.y,ret->levels[0]->verts[i].y),fmax(max.z,ret->levels[0]->verts[i].z));
+    }
+    /*Vertices only ever move to other vertices or midpoints, so the sphere holds every level*/
+    ret->center=qlvscale(qlvsum(min,max),0.5);
+    ret->radius=sqrt(qlvdot(qlvsub(max,ret->center),qlvsub(max,ret->center)));
+
+    while(ret->nlevels<maxlevels)
+    {
+        prev=w.alivecount;
+        while(w.alivecount>prev/2&&qllodpass(&w,prev/2)){}
+        /*A level that removes less than a tenth of the triangles isn't worth keeping*/
+        if(!w.alivecount||w.alivecount*10>prev*9)break;
+        ret->levels[ret->nlevels]=qllodmesh(&w);
+        ret->error[ret->nlevels]=qlloderror(&w);
+        ret->tris[ret->nlevels]=qllodtris(ret->levels[ret->nlevels]);
+        ret->nlevels++;
+    }
+
+    free(w.pos);
+    free(w.q);
+    free(w.into);
+    free(w.locked);
+    free(w.touched);
+    free(w.mark);
+    free(w.idx);
+    free(w.alive);
+    free(w.adjstart);
+    free(w.adj);
+    return ret;
+}
+
+void freeqllod(qllod **lod)
+{
+    int i;
+    if(!lod||!(*lod))return;
+    for(i=0;i<(*lod)->nlevels;i++)
+    {
+        freeqlmesh(&(*lod)->levels[i]);
+        free((*lod)->tris[i]);
+    }
+    free(*lod);
+    *lod=NULL;
+}
+
+/*Pixels a unit of length spans on the camera's image, at the nearest point of the lod's bounding sphere*/
+static double qllodscale(const qllod *lod,const qlcamera *camera)
+{
+    double d,spacing;
+    /*Depth of the nearest point of the bounding sphere in front of the image plane*/
+    d=qlvdot(qlvsub(lod->center,camera->pos),qlvnormalize(camera->dir))-lod->radius;
+    if(d<0)d=0;
+    spacing=fmin(camera->w/(camera->image->w-1),camera->h/(camera->image->h-1));
+    /*Rays spread from the focal point, fl behind the image plane: at depth d, neighbouring rays are spacing*(d+fl)/fl apart*/
+    return camera->fl/((d+camera->fl)*spacing);
+}
+
+int qllodlevel(const qllod *lod,const qlcamera *camera,double maxerror)
+{
+    double scale;
+    int l;
+    if(!lod||!camera)return 0;
+    scale=qllodscale(lod,camera);
+    for(l=lod->nlevels-1;l>0;l--)
+        if(lod->error[l]*scale<=maxerror)break;
+    return l;
+}
+
+/*A node being grouped with its neighbours, at the grid coordinates of its level of the hierarchy*/
+typedef struct _qllodcell{
+    int x,y,z;
+    int tri;/*Triangle (when sorting triangles into cells) or node*/
+} qllodcell;
+
+static int qllodcellcmp(const void *a,const void *b)
+{
+    const qllodcell *p=a,*q=b;
+    if(p->x!=q->x)return p->x<q->x?-1:1;
+    if(p->y!=q->y)return p->y<q->y?-1:1;
+    if(p->z!=q->z)return p->z<q->z?-1:1;
+    return p->tri<q->tri?-1:p->tri>q->tri;
+}
+
+/*Adds a node with the levels of detail of a NULL-terminated list of triangles. Returns its index, or -1 on errors.*/
+static int qllodaddnode(qllodscene *scene,const qltri **tris)
+{
+    qlmesh *mesh=qltrisToQlmesh(tris);
+    qllodnode *node=&scene->nodes[scene->n];
+    node->lod=Qllod(mesh,QL_LOD_LEVELS);
+    node->nchildren=0;
+    freeqlmesh(&mesh);
+    return node->lod?scene->n++:-1;
+}
+
+qllodscene *Qllodscene(const qltri **tris,double size)
+{
+    qllodscene *ret;
+    qllodcell *cells,min;
+    qllodnode *node;
+    const qllod *child;
+    const qltri **list;
+    qlvect c;
+    double base;
+    int len,i,j,k,l,lv,n,m,id,moved;
+    if(!tris||!(size>0))return NULL;
+    for(len=0;tris[len];len++){}
+    if(!len)return NULL;
+    cells=malloc(sizeof(qllodcell)*len);
+    for(i=0;i<len;i++)
+    {
+        c=qlvscale(qlvsum(qlvsum(tris[i]->a,tris[i]->b),tris[i]->c),1.0/3);
+        cells[i].x=floor(c.x/size);
+        cells[i].y=floor(c.y/size);
+        cells[i].z=floor(c.z/size);
+        cells[i].tri=i;
+        if(!i||cells[i].x<min.x)min.x=cells[i].x;
+        if(!i||cells[i].y<min.y)min.y=cells[i].y;
+        if(!i||cells[i].z<min.z)min.z=cells[i].z;
+    }
+    /*Grid coordinates start at 0, as halving them only brings non-negative ones together (-1>>1 is still -1)*/
+    for(i=0;i<len;i++)
+    {
+        cells[i].x-=min.x;
+        cells[i].y-=min.y;
+        cells[i].z-=min.z;
+    }
+    qsort(cells,len,sizeof(qllodcell),qllodcellcmp);
+    ret=malloc(sizeof(qllodscene));
+    /*A tree with a leaf per triangle at most has fewer than two nodes per triangle*/
+    ret->nodes=malloc(sizeof(qllodnode)*2*len);
+    ret->n=0;
+    ret->len=len;
+    ret->list=malloc(sizeof(qltri*)*(len+1));
+    ret->list[0]=NULL;
+    ret->selected=0;
+    list=malloc(sizeof(qltri*)*(len+1));
+
+    /*The grid's cells are the leaves*/
+    for(i=0,n=0;i<len;i=j)
+    {
+        for(j=i,k=0;j<len&&!qllodcellcmp(&(qllodcell){cells[j].x,cells[j].y,cells[j].z,0},&(qllodcell){cells[i].x,cells[i].y,cells[i].z,0});j++)
+            list[k++]=tris[cells[j].tri];
+        list[k]=NULL;
+        if((id=qllodaddnode(ret,list))<0)continue;
+        cells[n]=cells[i];
+        cells[n++].tri=id;
+    }
+    ret->ncells=ret->n;
+
+    /*Groups of up to 2x2x2 nodes are merged into a parent until one is left*/
+    while(n>1)
+    {
+        for(i=0,moved=0;i<n;i++)
+        {
+            moved|=cells[i].x|cells[i].y|cells[i].z;
+            cells[i].x>>=1;
+            cells[i].y>>=1;
+            cells[i].z>>=1;
+        }
+        qsort(cells,n,sizeof(qllodcell),qllodcellcmp);
+        for(i=0,m=0;i<n;i=j)
+        {
+            for(j=i+1;j<n&&cells[j].x==cells[i].x&&cells[j].y==cells[i].y&&cells[j].z==cells[i].z;j++){}
+            id=cells[i].tri;
+            if(j-i>1)
+            {
+                base=0;
+                for(k=i,l=0;k<j;k++)
+                {
+                    /*Each child gives the level with about 1/(j-i) of its triangles, so a parent is about as big as a child*/
+                    child=ret->nodes[cells[k].tri].lod;
+                    for(lv=0;lv<child->nlevels-1&&child->levels[lv]->ntris*(j-i)>child->levels[0]->ntris;lv++){}
+                    for(id=0;id<child->levels[lv]->ntris;id++)list[l++]=&child->tris[lv][id];
+                    if(child->error[lv]>base)base=child->error[lv];
+                }
+                list[l]=NULL;
+                if((id=qllodaddnode(ret,list))<0)break;
+                /*The parent's errors are measured from its children's coarsest levels, which are already off by up to base*/
+                node=&ret->nodes[id];
+                for(l=0;l<node->lod->nlevels;l++)node->lod->error[l]+=base;
+                for(k=i;k<j;k++)node->children[node->nchildren++]=cells[k].tri;
+            }
+            cells[m]=cells[i];
+            cells[m++].tri=id;
+        }
+        /*A pass that neither moves nor merges anything would repeat forever*/
+        if(i<n||(m==n&&!moved))break;
+        n=m;
+    }
+    ret->root=n==1?cells[0].tri:-1;
+    free(list);
+    free(cells);
+    if(ret->root<0)freeqllodscene(&ret);
+    return ret;
+}
+
+void freeqllodscene(qllodscene **scene)
+{
+    int i;
+    if(!scene||!(*scene))return;
+    for(i=0;i<(*scene)->n;i++)freeqllod(&(*scene)->nodes[i].lod);
+    free((*scene)->nodes);
+    free((*scene)->list);
+    free(*scene);
+    *scene=NULL;
+}
+
+/*Adds the triangles of a node, or of its children if it's too coarse, to the scene's list from index n. Returns the new length.*/
+static int qllodselectnode(qllodscene *scene,int i,const qlcamera *camera,const qlfrustum *frustum,double maxerror,int n)
+{
+    const qllodnode *node=&scene->nodes[i];
+    const qllod *lod=node->lod;
+    int k,l;
+    if(!qlfrustumsphere(frustum,&lod->center,lod->radius))return n;
+    if(node->nchildren&&lod->error[0]*qllodscale(lod,camera)>maxerror)
+    {
+        for(k=0;k<node->nchildren;k++)n=qllodselectnode(scene,node->children[k],camera,frustum,maxerror,n);
+        return n;
+    }
+    l=qllodlevel(lod,camera,maxerror);
+    for(k=0;k<lod->levels[l]->ntris;k++)scene->list[n++]=&lod->tris[l][k];
+    return n;
+}
+
+const qltri **qllodselect(qllodscene *scene,const qlcamera *camera,double maxerror)
+{
+    qlfrustum frustum;
+    int n;
+    if(!scene||!camera)return NULL;
+    qlcamerafrustum(camera,&frustum);
+    n=qllodselectnode(scene,scene->root,camera,&frustum,maxerror,0);
+    scene->list[n]=NULL;
+    scene->selected=n;
+    return scene->list;
+}
@@ -0,0 +1,102 @@
+/*
+Quicklight raycaster-like renderer - Level of detail
+
+Copyright (c) 2020 Amélia O. F. da S.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef QLLOD
+#define QLLOD
+
+#include "./quicklight.h"
+#include "./qlmesh.h"
+
+/*
+Levels of detail, built by edge collapse.
+Each level of a mesh has about half the triangles of the previous one. Edges are collapsed in the order of the
+error they add, estimated with quadrics (the sum of squared distances from the new vertex to the planes of the
+original triangles merged into it). A collapse is skipped if a triangle around the edge would flip over or the
+mesh would stop being manifold. Vertices on the mesh's open borders never move, so meshes that share a border
+keep meeting at every level.
+The error of a level is the largest distance from a vertex of the original mesh to the triangles around the
+vertex it was merged into. At draw time, the coarsest level whose error projects to at most the given number
+of pixels is picked.
+*/
+
+/*Maximum number of levels of a mesh, including the original*/
+#define QL_LOD_LEVELS 8
+
+/*A mesh and its simplified versions*/
+typedef struct _qllod{
+    int nlevels;/*Number of levels*/
+    qlmesh *levels[QL_LOD_LEVELS];/*levels[0] is a copy of the original mesh, and each one has fewer triangles than the previous*/
+    qltri *tris[QL_LOD_LEVELS];/*The triangles of each level, for the list-based trace functions*/
+    double error[QL_LOD_LEVELS];/*Error of each level, in the mesh's units*/
+    qlvect center;/*Centre of the mesh's bounding sphere*/
+    double radius;/*Radius of the mesh's bounding sphere*/
+} qllod;
+/*
+Builds up to maxlevels levels of detail of a mesh (the mesh is copied).
+Levels stop where simplifying no longer removes a significant number of triangles.
+Returns NULL on errors. One should free it with freeqllod.
+*/
+qllod *Qllod(const qlmesh *mesh,int maxlevels);
+/*Frees a qllod object*/
+void freeqllod(qllod **lod);
+/*The coarsest level of lod whose error projects to at most maxerror pixels on the camera's image*/
+int qllodlevel(const qllod *lod,const qlcamera *camera,double maxerror);
+
+/*A node of a qllodscene's hierarchy*/
+typedef struct _qllodnode{
+    qllod *lod;/*Levels of detail of the node's mesh*/
+    int children[8];/*Indices of the node's children*/
+    int nchildren;/*Number of children (0 for the grid's cells)*/
+} qllodnode;
+
+/*
+A scene split into the cells of a grid (as qlchunkwrite does), with levels of detail for each cell, and a hierarchy
+above them: groups of up to 2x2x2 neighbouring nodes are merged into a parent, made of coarser levels of its
+children (so that it has about as many triangles as one of them) and simplified further, up to a single root. A parent's errors include the ones of the levels it was made from.
+Nodes only share open borders, which never move, so drawing neighbouring nodes at different levels leaves no cracks.
+*/
+typedef struct _qllodscene{
+    int n;/*Number of nodes*/
+    qllodnode *nodes;/*Nodes: the grid's cells first, then their parents*/
+    int ncells;/*Number of the grid's cells*/
+    int root;/*Index of the root node*/
+    int len;/*Number of triangles at full detail*/
+    const qltri **list;/*NULL-terminated list of the triangles picked by the last qllodselect*/
+    int selected;/*Number of triangles in list*/
+} qllodscene;
+/*
+Builds the levels of detail of a NULL-terminated list of triangles, grouped by the cell of a grid of the given
+size their centroid falls in. Returns NULL on errors. One should free it with freeqllodscene.
+*/
+qllodscene *Qllodscene(const qltri **tris,double size);
+/*Frees a qllodscene object*/
+void freeqllodscene(qllodscene **scene);
+/*
+Picks the triangles to draw a frame with: walking down from the root, the first nodes that may be in view and have
+a level whose error projects to at most maxerror pixels, each at the coarsest such level (0 picks the full detail).
+Returns the NULL-terminated list (scene->list).
+*/
+const qltri **qllodselect(qllodscene *scene,const qlcamera *camera,double maxerror);
+
+#endif
@@ -0,0 +1,368 @@
+#include "./qlmesh.h"
+#include "./qlstats.h"
+#include "./qlvect.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+/*
+Copyright (c) 2020 Amélia O. F. da S.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+unsigned char qlmeshcolour[3]={200,200,200};
+
+qlmesh *Qlmesh(int nverts,int ntris)
+{
+    qlmesh *ret=malloc(sizeof(qlmesh));
+    ret->vcap=nverts>16?nverts:16;
+    ret->tcap=ntris>16?ntris:16;
+    ret->verts=malloc(sizeof(qlvect)*ret->vcap);
+    ret->idx=malloc(sizeof(unsigned int)*3*ret->tcap);
+    ret->colours=malloc(3*ret->tcap);
+    ret->nverts=0;
+    ret->ntris=0;
+    return ret;
+}
+
+void freeqlmesh(qlmesh **mesh)
+{
+    if(!mesh||!(*mesh))return;
+    free((*mesh)->verts);
+    free((*mesh)->idx);
+    free((*mesh)->colours);
+    free(*mesh);
+    *mesh=NULL;
+}
+
+int qlmeshvert(qlmesh *mesh,const qlvect *v)
+{
+    if(!mesh||!v)return -1;
+    if(mesh->nverts==mesh->vcap)
+    {
+        mesh->vcap*=2;
+        mesh->verts=realloc(mesh->verts,sizeof(qlvect)*mesh->vcap);
+    }
+    mesh->verts[mesh->nverts]=*v;
+    return mesh->nverts++;
+}
+
+int qlmeshtri(qlmesh *mesh,unsigned int a,unsigned int b,unsigned int c,const unsigned char *colour)
+{
+    if(!mesh||a>=(unsigned int)mesh->nverts||b>=(unsigned int)mesh->nverts||c>=(unsigned int)mesh->nverts)return -1;
+    if(!colour)colour=qlmeshcolour;
+    if(mesh->ntris==mesh->tcap)
+    {
+        mesh->tcap*=2;
+        mesh->idx=realloc(mesh->idx,sizeof(unsigned int)*3*mesh->tcap);
+        mesh->colours=realloc(mesh->colours,3*mesh->tcap);
+    }
+    mesh->idx[mesh->ntris*3]=a;
+    mesh->idx[mesh->ntris*3+1]=b;
+    mesh->idx[mesh->ntris*3+2]=c;
+    memcpy(mesh->colours+mesh->ntris*3,colour,3);
+    return mesh->ntris++;
+}
+
+/*
+Vertex welding.
+An open-addressing hash table from coordinates to vertex indices, so identical vertices are stored once.
+*/
+typedef struct _qlweld{
+    int *slots;/*Vertex index of each slot (-1 when empty)*/
+    unsigned int mask;/*Number of slots - 1 (a power of two)*/
+} qlweld;
+
+static void qlweldinit(qlweld *weld,int n)
+{
+    unsigned int size=64;
+    while(size<(unsigned int)n*2)size*=2;
+    weld->slots=malloc(sizeof(int)*size);
+    memset(weld->slots,-1,sizeof(int)*size);
+    weld->mask=size-1;
+}
+
+static unsigned int qlweldhash(const qlvect *v)
+{
+    unsigned long long k[3],h=1469598103934665603ULL;
+    int i;
+    /*+0.0 so that -0 and 0 hash the same*/
+    double c[3]={v->x+0.0,v->y+0.0,v->z+0.0};
+    memcpy(k,c,sizeof(k));
+    for(i=0;i<3;i++)
+    {
+        h^=k[i];
+        h*=1099511628211ULL;
+        h^=h>>29;
+    }
+    return h;
+}
+
+/*Returns the index of a vertex equal to v in the mesh, adding it if there's none*/
+static int qlweldvert(qlweld *weld,qlmesh *mesh,const qlvect *v)
+{
+    unsigned int i,j;
+    int *slots;
+    qlvect *u;
+    for(i=qlweldhash(v)&weld->mask;weld->slots[i]>=0;i=(i+1)&weld->mask)
+    {
+        u=&mesh->verts[weld->slots[i]];
+        if(u->x==v->x&&u->y==v->y&&u->z==v->z)return weld->slots[i];
+    }
+    weld->slots[i]=qlmeshvert(mesh,v);
+    if((unsigned int)mesh->nverts*2>weld->mask)
+    {
+        /*Keep the table at most half full*/
+        slots=weld->slots;
+        j=weld->mask+1;
+        qlweldinit(weld,j);
+        for(i=0;i<j;i++)
+        {
+            if(slots[i]<0)continue;
+            unsigned int k=qlweldhash(&mesh->verts[slots[i]])&weld->mask;
+            while(weld->slots[k]>=0)k=(k+1)&weld->mask;
+            weld->slots[k]=slots[i];
+        }
+        free(slots);
+    }
+    return mesh->nverts-1;
+}
+
+/*OBJ*/
+
+/*A material from a .mtl file*/
+typedef struct _qlmtl{
+    char name[64];
+    unsigned char colour[3];
+} qlmtl;
+
+/*Reads the materials of a .mtl file (path relative to the .obj file that references it)*/
+static qlmtl *qlreadmtl(const char *objname,const char *mtlname,int *n)
+{
+    char path[1024],line[1024],*p;
+    const char *slash=strrchr(objname,'/');
+    qlmtl *ret=NULL;
+    int cap=0,len=slash?slash-objname+1:0,i;
+    double c[3];
+    FILE *f;
+    *n=0;
+    if(len+strlen(mtlname)>=sizeof(path))return NULL;
+    memcpy(path,objname,len);
+    strcpy(path+len,mtlname);
+    f=fopen(path,"r");
+    if(!f)return NULL;
+    while(fgets(line,sizeof(line),f))
+    {
+        for(p=line;*p==' '||*p=='\t';p++){}
+        if(!strncmp(p,"newmtl",6))
+        {
+            if(*n==cap)
+            {
+                cap=cap?cap*2:8;
+                ret=realloc(ret,sizeof(qlmtl)*cap);
+            }
+            if(sscanf(p+6," %63s",ret[*n].name)!=1)continue;
+            memcpy(ret[*n].colour,qlmeshcolour,3);
+            (*n)++;
+        }
+        else if(*n&&!strncmp(p,"Kd",2)&&sscanf(p+2,"%lf %lf %lf",&c[0],&c[1],&c[2])==3)
+            for(i=0;i<3;i++)ret[*n-1].colour[i]=c[i]<0?0:c[i]>1?255:c[i]*255;
+    }
+    fclose(f);
+    return ret;
+}
+
+qlmesh *qlobjToQlmesh(const char *fname)
+{
+    FILE *f=fopen(fname,"r");
+    if(!f)return NULL;
+    qlmesh *ret=Qlmesh(1024,2048);
+    qlmtl *mtls=NULL,*m;
+    int nmtls=0,i,n,first,prev;
+    long v;
+    unsigned char colour[3];
+    char *line=NULL,*p,*end,name[64];
+    size_t cap=0;
+    qlvect vert;
+    memcpy(colour,qlmeshcolour,3);
+    while(getline(&line,&cap,f)>0)
+    {
+        for(p=line;*p==' '||*p=='\t';p++){}
+        if(p[0]=='v'&&(p[1]==' '||p[1]=='\t'))
+        {
+            vert.x=strtod(p+2,&end);
+            vert.y=strtod(end,&end);
+            vert.z=strtod(end,&end);
+            qlmeshvert(ret,&vert);
+        }
+        else if(p[0]=='f'&&(p[1]==' '||p[1]=='\t'))
+        {
+            /*Each corner is v, v/vt, v//vn or v/vt/vn. Negative indices count back from the last vertex.*/
+            p+=2;
+            first=prev=-1;
+            for(n=0;;n++)
+            {
+                v=strtol(p,&end,10);
+                if(end==p)break;
+                for(p=end;*p&&*p!=' '&&*p!='\t'&&*p!='\n'&&*p!='\r';p++){}
+                v=v<0?ret->nverts+v:v-1;
+                if(v<0||v>=ret->nverts)break;
+                if(n==0)first=v;
+                else if(n>1)qlmeshtri(ret,first,prev,v,colour);
+                prev=v;
+            }
+        }
+        else if(!strncmp(p,"usemtl",6)&&sscanf(p+6," %63s",name)==1)
+        {
+            memcpy(colour,qlmeshcolour,3);
+            for(i=0,m=mtls;i<nmtls;i++,m++)
+                if(!strcmp(m->name,name))memcpy(colour,m->colour,3);
+        }
+        else if(!strncmp(p,"mtllib",6)&&sscanf(p+6," %63s",name)==1)
+        {
+            free(mtls);
+            mtls=qlreadmtl(fname,name,&nmtls);
+        }
+    }
+    free(line);
+    free(mtls);
+    fclose(f);
+    return ret;
+}
+
+/*STL*/
+
+static float qlgetfloat(const unsigned char *p)
+{
+    unsigned int u=p[0]|(p[1]<<8)|(p[2]<<16)|((unsigned int)p[3]<<24);
+    float ret;
+    memcpy(&ret,&u,4);
+    return ret;
+}
+
+qlmesh *qlstlToQlmesh(const char *fname)
+{
+    unsigned char header[84],tri[50];
+    unsigned char colour[3];
+    unsigned int n,i,j,k,idx[3],attr;
+    long size;
+    qlvect v;
+    qlweld weld;
+    qlmesh *ret;
+    FILE *f=fopen(fname,"rb");
+    if(!f)return NULL;
+    fseek(f,0,SEEK_END);
+    size=ftell(f);
+    fseek(f,0,SEEK_SET);
+    if(fread(header,1,84,f)!=84){fclose(f);return NULL;}
+    n=header[80]|(header[81]<<8)|(header[82]<<16)|((unsigned int)header[83]<<24);
+    /*ASCII files (or truncated ones) don't match the size given by the triangle count*/
+    if(size!=84+50*(long)n){fclose(f);return NULL;}
+    /*Closed meshes have about half as many vertices as triangles*/
+    ret=Qlmesh(n/2+3,n);
+    qlweldinit(&weld,n/2+3);
+    for(i=0;i<n;i++)
+    {
+        if(fread(tri,1,50,f)!=50)break;
+        for(j=0;j<3;j++)
+        {
+            v.x=qlgetfloat(tri+12+j*12);
+            v.y=qlgetfloat(tri+16+j*12);
+            v.z=qlgetfloat(tri+20+j*12);
+            idx[j]=qlweldvert(&weld,ret,&v);
+        }
+        attr=tri[48]|(tri[49]<<8);
+        if(attr&&!(attr&0x8000))
+        {
+            /*VisCAM: 5 bits per channel, blue in the lowest bits*/
+            for(k=0;k<3;k++)colour[2-k]=((attr>>(k*5))&31)*255/31;
+            qlmeshtri(ret,idx[0],idx[1],idx[2],colour);
+        }
+        else qlmeshtri(ret,idx[0],idx[1],idx[2],NULL);
+    }
+    free(weld.slots);
+    fclose(f);
+    return ret;
+}
+
+qlmesh *qltrisToQlmesh(const qltri **tris)
+{
+    qlmesh *ret;
+    qlweld weld;
+    unsigned char colour[3];
+    int i,n;
+    if(!tris)return NULL;
+    for(n=0;tris[n];n++){}
+    ret=Qlmesh(n/2+3,n);
+    qlweldinit(&weld,n/2+3);
+    for(i=0;i<n;i++)
+    {
+        memcpy(colour,tris[i]->colour,3);
+        qlmeshtri(ret,qlweldvert(&weld,ret,&tris[i]->a),qlweldvert(&weld,ret,&tris[i]->b),qlweldvert(&weld,ret,&tris[i]->c),colour);
+    }
+    free(weld.slots);
+    return ret;
+}
+
+/*Raycasting functions*/
+
+void qlcalcraymesh(qlray *ray,const qlmesh *mesh)
+{
+    int i,p;
+    double s,min=INFINITY;
+    const unsigned int *idx;
+    const qlvect *a,*b,*c;
+    qlvect dir;
+    if(!ray||!mesh)return;
+    p=ray->rx+ray->ry*ray->screen->w;
+    dir=qlvnormalize(ray->dir);
+    QL_STAT_INC(rays);
+    for(i=0,idx=mesh->idx;i<mesh->ntris;i++,idx+=3)
+    {
+        a=&mesh->verts[idx[0]];
+        b=&mesh->verts[idx[1]];
+        c=&mesh->verts[idx[2]];
+        if((s=qlvhit(ray->pos,dir,*a,*b,*c,min<ray->depth?min:ray->depth))<INFINITY)
+        {
+            min=s;
+            qlputpixel(ray->screen,p,mesh->colours[i*3],mesh->colours[i*3+1],mesh->colours[i*3+2]);
+        }
+    }
+    ray->screen->z[p]=min;
+    if(min>ray->depth)qlputpixel(ray->screen,p,0,0,0);
+}
+
+static void qlcalcraymesharg(qlray *ray,const void *mesh)
+{
+    qlcalcraymesh(ray,mesh);
+}
+
+void qltracerowsmesh(qlcamera *camera,const qlmesh *mesh,int y0,int y1)
+{
+    if(!camera||!mesh)return;
+    qltracerowswith(camera,qlcalcraymesharg,mesh,y0,y1);
+}
+
+void qlstepmesh(qlcamera *camera,const qlmesh *mesh)
+{
+    if(!camera||!mesh)return;
+    qltracerowsmesh(camera,mesh,0,camera->image->h);
+    qlshade(camera);
+}
@@ -0,0 +1,81 @@
+/*
+Quicklight raycaster-like renderer - Indexed meshes
+
+Copyright (c) 2020 Amélia O. F. da S.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#ifndef QLMESH
+#define QLMESH
+
+#include "./quicklight.h"
+
+/*
+An indexed triangle mesh.
+Vertices are stored once and shared by every triangle that uses them, instead of being copied into each qltri.
+*/
+typedef struct _qlmesh{
+    qlvect *verts;/*Vertex array*/
+    int nverts;/*Number of vertices*/
+    unsigned int *idx;/*Vertex indices, three for each triangle*/
+    unsigned char *colours;/*Triangle colours, three bytes (RGB) for each triangle*/
+    int ntris;/*Number of triangles*/
+    int vcap;/*Number of vertices allocated*/
+    int tcap;/*Number of triangles allocated*/
+} qlmesh;
+/*
+Instantiates an empty qlmesh object with room for nverts vertices and ntris triangles (it grows as needed).
+One should free it with freeqlmesh.
+*/
+qlmesh *Qlmesh(int nverts,int ntris);
+/*Frees a qlmesh object*/
+void freeqlmesh(qlmesh **mesh);
+/*Appends a vertex to a mesh and returns its index (or -1 on errors)*/
+int qlmeshvert(qlmesh *mesh,const qlvect *v);
+/*Appends a triangle made of vertices a, b and c to a mesh and returns its index (or -1 on errors)*/
+int qlmeshtri(qlmesh *mesh,unsigned int a,unsigned int b,unsigned int c,const unsigned char *colour);
+
+/*Colour given to triangles that come without one*/
+extern unsigned char qlmeshcolour[3];
+
+/*
+Reads a Wavefront OBJ file. Polygons are split into triangle fans, and triangles are coloured with the
+diffuse colour (Kd) of their material when the file's mtllib can be found. Returns NULL on errors.
+*/
+qlmesh *qlobjToQlmesh(const char *fname);
+/*
+Reads a binary STL file, merging vertices with the same coordinates.
+Triangles are coloured from their attribute bytes when they follow the VisCAM/SolidView convention. Returns NULL on errors.
+*/
+qlmesh *qlstlToQlmesh(const char *fname);
+/*Builds a mesh from a NULL-sentinel-terminated list of triangles (e.g. from qltToQltriList), merging vertices with the same coordinates*/
+qlmesh *qltrisToQlmesh(const qltri **tris);
+
+/*Raycasting functions*/
+
+/*Same as qlcalcray, for the triangles of a mesh*/
+void qlcalcraymesh(qlray *ray,const qlmesh *mesh);
+/*Same as qltracerows, for the triangles of a mesh*/
+void qltracerowsmesh(qlcamera *camera,const qlmesh *mesh,int y0,int y1);
+/*Same as qlstep, for the triangles of a mesh*/
+void qlstepmesh(qlcamera *camera,const qlmesh *mesh);
+
+#endif
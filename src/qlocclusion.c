@@ -0,0 +1,233 @@
+#include "./qlocclusion.h"
+#include "./qlscene.h"
+#include "./qlvect.h"
+#include "./qlstats.h"
+#include <stdlib.h>
+#include <math.h>
+/*
+Copyright (c) 2020 Amélia O. F. da S.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+qlocclusion *Qlocclusion(const qlcamera *camera)
+{
+    qlocclusion *ret;
+    int i,w,h;
+    if(!camera)return NULL;
+    ret=malloc(sizeof(qlocclusion));
+    ret->w=camera->image->w;
+    ret->h=camera->image->h;
+    ret->points=malloc(sizeof(qlvect)*ret->w*ret->h);
+    ret->npoints=0;
+    ret->scratch=malloc(sizeof(float)*ret->w*ret->h);
+    for(ret->levels=1,w=ret->w,h=ret->h;w>1||h>1;ret->levels++,w=(w+1)/2,h=(h+1)/2){}
+    ret->pyramid=malloc(sizeof(float*)*ret->levels);
+    for(i=0,w=ret->w,h=ret->h;i<ret->levels;i++,w=(w+1)/2,h=(h+1)/2)
+        ret->pyramid[i]=malloc(sizeof(float)*w*h);
+    ret->tested=0;
+    ret->culled=0;
+    return ret;
+}
+
+void freeqlocclusion(qlocclusion **occ)
+{
+    int i;
+    if(!occ||!(*occ))return;
+    for(i=0;i<(*occ)->levels;i++)free((*occ)->pyramid[i]);
+    free((*occ)->pyramid);
+    free((*occ)->points);
+    free((*occ)->scratch);
+    free(*occ);
+    *occ=NULL;
+}
+
+void qlocclusionstore(qlocclusion *occ,const qlcamera *camera)
+{
+    int i,n=0;
+    double z;
+    const qlray *ray;
+    if(!occ||!camera||camera->image->w!=occ->w||camera->image->h!=occ->h)return;
+    for(i=0;i<occ->w*occ->h;i++)
+    {
+        z=camera->image->z[i];
+        if(!isfinite(z))continue;
+        ray=camera->rays[i];
+        occ->points[n++]=qlvsum(ray->pos,qlvscale(ray->dir,z));
+    }
+    occ->npoints=n;
+}
+
+void qlocclusionreset(qlocclusion *occ)
+{
+    if(!occ)return;
+    occ->npoints=0;
+}
+
+/*
+The camera's geometry, in the frame of its image plane:
+a point at v from the focal point projects to pixel x=(d*(v.ex)/(v.n)-offx+w/2)*sx (and likewise for y)
+*/
+typedef struct _qlocclusionview{
+    qlvect focal,ex,ey,n;
+    double d;/*Distance from the focal point to the image plane*/
+    double offx,offy;/*Position of the camera (the image's centre) on the image plane, seen from the focal point*/
+    double sx,sy;/*Pixels per world unit on the image plane*/
+} qlocclusionview;
+
+static void qlocclusionsetview(qlocclusionview *view,const qlcamera *camera)
+{
+    qlvect toplane;
+    qlcamerabasis(camera,&view->ex,&view->ey);
+    view->focal=qlvsub(camera->pos,qlvscale(qlvnormalize(camera->dir),camera->fl));
+    toplane=qlvsub(camera->pos,view->focal);
+    view->n=qlvnormalize(qlvcross(view->ex,view->ey));
+    if(qlvdot(view->n,toplane)<0)view->n=qlvscale(view->n,-1);
+    view->d=qlvdot(view->n,toplane);
+    view->offx=qlvdot(view->ex,toplane);
+    view->offy=qlvdot(view->ey,toplane);
+    view->sx=(camera->image->w-1)/camera->w;
+    view->sy=(camera->image->h-1)/camera->h;
+}
+
+/*Reprojects the stored points and builds the pyramid*/
+static void qlocclusionbuild(qlocclusion *occ,const qlcamera *camera,const qlocclusionview *view)
+{
+    int i,x,y,xx,yy,w=occ->w,h=occ->h,k,pw,ph;
+    double c,px,py;
+    float dist,m,*in,*out;
+    qlvect v;
+    for(i=0;i<w*h;i++)occ->scratch[i]=-1;
+    for(i=0;i<occ->npoints;i++)
+    {
+        v=qlvsub(occ->points[i],view->focal);
+        c=qlvdot(v,view->n);
+        /*Rays start on the image plane, so nothing in front of it hides anything*/
+        if(c<=view->d)continue;
+        px=(view->d*qlvdot(v,view->ex)/c-view->offx+camera->w/2)*view->sx;
+        py=(view->d*qlvdot(v,view->ey)/c-view->offy+camera->h/2)*view->sy;
+        if(!(px>-0.5&&px<w-0.5&&py>-0.5&&py<h-0.5))continue;
+        x=(int)(px+0.5);
+        y=(int)(py+0.5);
+        /*Different surfaces may land on the same pixel: only the farthest is certain to be in front of its ray's hit*/
+        dist=sqrt(qlvdot(v,v));
+        if(dist>occ->scratch[x+y*w])occ->scratch[x+y*w]=dist;
+    }
+    /*Pixels nothing landed on are unknown, and so infinitely far; each pixel then takes the farthest of its neighbours*/
+    for(i=0;i<w*h;i++)if(occ->scratch[i]<0)occ->scratch[i]=INFINITY;
+    for(y=0;y<h;y++)
+        for(x=0;x<w;x++)
+        {
+            m=0;
+            for(yy=y>0?y-1:0;yy<=y+1&&yy<h;yy++)
+                for(xx=x>0?x-1:0;xx<=x+1&&xx<w;xx++)
+                    if(occ->scratch[xx+yy*w]>m)m=occ->scratch[xx+yy*w];
+            occ->pyramid[0][x+y*w]=m;
+        }
+    for(k=1,pw=w,ph=h;k<occ->levels;k++)
+    {
+        in=occ->pyramid[k-1];
+        out=occ->pyramid[k];
+        for(y=0;y<(ph+1)/2;y++)
+            for(x=0;x<(pw+1)/2;x++)
+            {
+                m=in[2*x+2*y*pw];
+                if(2*x+1<pw&&in[2*x+1+2*y*pw]>m)m=in[2*x+1+2*y*pw];
+                if(2*y+1<ph&&in[2*x+(2*y+1)*pw]>m)m=in[2*x+(2*y+1)*pw];
+                if(2*x+1<pw&&2*y+1<ph&&in[2*x+1+(2*y+1)*pw]>m)m=in[2*x+1+(2*y+1)*pw];
+                out[x+y*((pw+1)/2)]=m;
+            }
+        pw=(pw+1)/2;
+        ph=(ph+1)/2;
+    }
+}
+
+/*
+Pixel range [lo,hi] that a sphere centred at a (along one image axis) and c (along the normal) from the focal point
+may project to. Needs c-r>0.
+*/
+static void qlocclusionspan(double a,double c,double r,double d,double off,double half,double s,int *lo,int *hi)
+{
+    double min=(a-r)/(a-r<0?c-r:c+r),max=(a+r)/(a+r>0?c-r:c+r);
+    *lo=(int)floor((d*min-off+half)*s);
+    *hi=(int)ceil((d*max-off+half)*s);
+}
+
+/*Whether the sphere is farther than everything stored over the pixels it may cover*/
+static char qlocclusionhidden(const qlocclusion *occ,const qlcamera *camera,const qlocclusionview *view,qlvect center,double r)
+{
+    qlvect v=qlvsub(center,view->focal);
+    double c=qlvdot(v,view->n),near=sqrt(qlvdot(v,v))-r;
+    int x0,x1,y0,y1,k,lw,x,y;
+    float m=0;
+    if(c-r<=view->d)return 0;
+    qlocclusionspan(qlvdot(v,view->ex),c,r,view->d,view->offx,camera->w/2,view->sx,&x0,&x1);
+    qlocclusionspan(qlvdot(v,view->ey),c,r,view->d,view->offy,camera->h/2,view->sy,&y0,&y1);
+    if(x0<0)x0=0;
+    if(y0<0)y0=0;
+    if(x1>occ->w-1)x1=occ->w-1;
+    if(y1>occ->h-1)y1=occ->h-1;
+    if(x0>x1||y0>y1)return 0;
+    /*The coarsest level where the range spans at most two blocks each way*/
+    for(k=0,lw=occ->w;(x1>>k)-(x0>>k)>1||(y1>>k)-(y0>>k)>1;k++)lw=(lw+1)/2;
+    for(y=y0>>k;y<=y1>>k;y++)
+        for(x=x0>>k;x<=x1>>k;x++)
+            if(occ->pyramid[k][x+y*lw]>m)m=occ->pyramid[k][x+y*lw];
+    return m<near;
+}
+
+int qlocclusioncull(qlocclusion *occ,const qlcamera *camera,const qltri **list)
+{
+    qlocclusionview view;
+    qlvect center;
+    double r;
+    int i,n=0;
+    const qltri *t;
+    if(!list)return 0;
+    if(!occ||!camera||camera->image->w!=occ->w||camera->image->h!=occ->h)
+    {
+        for(;list[n];n++){}
+        return n;
+    }
+    occ->tested=0;
+    occ->culled=0;
+    if(occ->npoints)
+    {
+        qlocclusionsetview(&view,camera);
+        qlocclusionbuild(occ,camera,&view);
+    }
+    for(i=0;(t=list[i])!=NULL;i++)
+    {
+        occ->tested++;
+        if(occ->npoints)
+        {
+            qlscenebounds(t,&center,&r);
+            if(qlocclusionhidden(occ,camera,&view,center,r))
+            {
+                occ->culled++;
+                continue;
+            }
+        }
+        list[n++]=t;
+    }
+    list[n]=NULL;
+    QL_STAT_ADD(occtests,occ->tested);
+    QL_STAT_ADD(occculled,occ->culled);
+    return n;
+}
@@ -0,0 +1,71 @@
+/*
+Quicklight raycaster-like renderer - Occlusion culling
+
+Copyright (c) 2020 Amélia O. F. da S.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef QLOCCLUSION
+#define QLOCCLUSION
+
+#include "./quicklight.h"
+
+/*
+Occlusion culling against the previous frame.
+After a frame is traced, the world-space points its rays hit are stored. Before tracing the next one they are
+reprojected into the (possibly moved) camera, and their distances to the focal point are reduced into a pyramid
+of the farthest distance found over each block of pixels. A triangle whose bounding sphere is entirely farther
+than everything stored over the pixels it covers can't be the closest hit of any of them, so it is skipped.
+
+The test only ever relies on surfaces that were really seen, so it stays conservative under fast camera motion:
+pixels that no stored point lands on (disocclusions, the borders of a turn, surfaces spread out by approaching them)
+count as infinitely far, and each pixel also takes the farthest point of its neighbours, covering the rounding of
+the reprojection. Geometry is assumed to be static between frames: call qlocclusionreset after moving triangles.
+*/
+typedef struct _qlocclusion{
+    int w;/*Width of the camera image (and of the pyramid's first level)*/
+    int h;/*Height of the camera image*/
+    qlvect *points;/*World-space points hit by the last stored frame*/
+    int npoints;/*Number of stored points*/
+    int levels;/*Number of levels in the pyramid*/
+    float **pyramid;/*Farthest distance over each pixel (level 0) and over each 2^k x 2^k block (level k)*/
+    float *scratch;/*Reprojected distances, before the neighbourhood is taken into account*/
+    unsigned long long tested;/*Triangles tested by the last qlocclusioncull*/
+    unsigned long long culled;/*Triangles culled by the last qlocclusioncull*/
+} qlocclusion;
+/*
+Instantiates a qlocclusion object for cameras with <camera>'s image size.
+One should free it with freeqlocclusion.
+*/
+qlocclusion *Qlocclusion(const qlcamera *camera);
+/*Frees a qlocclusion object*/
+void freeqlocclusion(qlocclusion **occ);
+/*Stores the points hit by the frame the camera just traced (call it after qlstep or qltracerows)*/
+void qlocclusionstore(qlocclusion *occ,const qlcamera *camera);
+/*Forgets the stored frame, so that the next qlocclusioncull culls nothing*/
+void qlocclusionreset(qlocclusion *occ);
+/*
+Reprojects the stored frame into the camera (which must be up to date) and removes from the NULL-terminated list
+the triangles it hides, keeping the others in order. Returns how many triangles are left.
+Usually run on the output of qlscenecull, before tracing.
+*/
+int qlocclusioncull(qlocclusion *occ,const qlcamera *camera,const qltri **list);
+
+#endif
@@ -0,0 +1,123 @@
+#include "./qlpool.h"
+#include <stdlib.h>
+#include <unistd.h>
+/*
+Copyright (c) 2020 Amélia O. F. da S.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/*Hands out and runs jobs until there are none left. Must be called with the lock held.*/
+static void qlpooldrain(qlpool *pool)
+{
+    int job;
+    void (*fn)(void*,int);
+    void *arg;
+    while(pool->next<pool->njobs)
+    {
+        job=pool->next++;
+        fn=pool->fn;
+        arg=pool->arg;
+        pthread_mutex_unlock(&pool->lock);
+        fn(arg,job);
+        pthread_mutex_lock(&pool->lock);
+        if(++pool->finished==pool->njobs)pthread_cond_broadcast(&pool->done);
+    }
+}
+
+static void *qlpoolworker(void *p)
+{
+    qlpool *pool=p;
+    unsigned int seen=0;
+    pthread_mutex_lock(&pool->lock);
+    for(;;)
+    {
+        while(!pool->quit&&pool->run==seen)pthread_cond_wait(&pool->work,&pool->lock);
+        if(pool->quit)break;
+        seen=pool->run;
+        qlpooldrain(pool);
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+qlpool *Qlpool(int threads)
+{
+    qlpool *ret;
+    int i;
+    if(threads<=0)threads=sysconf(_SC_NPROCESSORS_ONLN);
+    if(threads<=0)threads=1;
+    ret=malloc(sizeof(qlpool));
+    if(!ret)return NULL;
+    ret->threads=malloc(sizeof(pthread_t)*threads);
+    ret->n=1;
+    pthread_mutex_init(&ret->lock,NULL);
+    pthread_cond_init(&ret->work,NULL);
+    pthread_cond_init(&ret->done,NULL);
+    ret->fn=NULL;
+    ret->arg=NULL;
+    ret->njobs=ret->next=ret->finished=0;
+    ret->run=0;
+    ret->quit=0;
+    for(i=0;i<threads-1;i++)
+    {
+        if(pthread_create(&ret->threads[i],NULL,qlpoolworker,ret))break;
+        ret->n++;
+    }
+    return ret;
+}
+
+void qlpoolrun(qlpool *pool,int njobs,void (*fn)(void *arg,int job),void *arg)
+{
+    int i;
+    if(!fn||njobs<=0)return;
+    if(!pool)
+    {
+        for(i=0;i<njobs;i++)fn(arg,i);
+        return;
+    }
+    pthread_mutex_lock(&pool->lock);
+    pool->fn=fn;
+    pool->arg=arg;
+    pool->njobs=njobs;
+    pool->next=0;
+    pool->finished=0;
+    pool->run++;
+    pthread_cond_broadcast(&pool->work);
+    qlpooldrain(pool);
+    while(pool->finished<pool->njobs)pthread_cond_wait(&pool->done,&pool->lock);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+void freeqlpool(qlpool **pool)
+{
+    int i;
+    if(!pool||!(*pool))return;
+    pthread_mutex_lock(&(*pool)->lock);
+    (*pool)->quit=1;
+    pthread_cond_broadcast(&(*pool)->work);
+    pthread_mutex_unlock(&(*pool)->lock);
+    for(i=0;i<(*pool)->n-1;i++)pthread_join((*pool)->threads[i],NULL);
+    pthread_mutex_destroy(&(*pool)->lock);
+    pthread_cond_destroy(&(*pool)->work);
+    pthread_cond_destroy(&(*pool)->done);
+    free((*pool)->threads);
+    free(*pool);
+    *pool=NULL;
+}
@@ -0,0 +1,62 @@
+/*
+Quicklight raycaster-like renderer - Thread pool
+
+Copyright (c) 2020 Amélia O. F. da S.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#ifndef QLPOOL
+#define QLPOOL
+
+#include <pthread.h>
+
+/*
+A pool of worker threads.
+Work is handed out as numbered jobs, which the workers (and the thread that submitted them) pick up in order.
+*/
+typedef struct _qlpool{
+    pthread_t *threads;/*Worker threads (the submitting thread works too, so there are n-1 of them)*/
+    int n;/*Number of threads working on each run, including the submitting one*/
+    pthread_mutex_t lock;
+    pthread_cond_t work;/*Signalled when a new run starts*/
+    pthread_cond_t done;/*Signalled when the last job of a run finishes*/
+    void (*fn)(void *arg,int job);/*Job function of the current run*/
+    void *arg;/*Argument of the current run*/
+    int njobs;/*Number of jobs of the current run*/
+    int next;/*Next job to be handed out*/
+    int finished;/*Number of jobs finished*/
+    unsigned int run;/*Run counter, so workers can tell a new run from a spurious wakeup*/
+    char quit;
+} qlpool;
+/*
+Instantiates a qlpool object with <threads> threads (threads<=0 uses one per online CPU).
+One should free it with freeqlpool, which also stops its threads.
+*/
+qlpool *Qlpool(int threads);
+/*
+Runs fn(arg,job) for every job in [0,njobs) on the pool and waits for all of them to finish.
+The calling thread works on the jobs too. fn must be safe to run concurrently for different jobs.
+*/
+void qlpoolrun(qlpool *pool,int njobs,void (*fn)(void *arg,int job),void *arg);
+/*Stops the pool's threads and frees it*/
+void freeqlpool(qlpool **pool);
+
+#endif
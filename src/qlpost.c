@@ -0,0 +1,252 @@
+#include "./qlpost.h"
+#include "./qlstats.h"
+#include <stdlib.h>
+#include <string.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+/*
+Copyright (c) 2020 Amélia O. F. da S.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+qlpost *Qlpost(int threads)
+{
+    qlpost *ret=malloc(sizeof(qlpost));
+    ret->pool=Qlpool(threads);
+    ret->filter=QL_POST_NEAREST;
+    ret->noise=0;
+    ret->frame=0;
+    ret->src=NULL;
+    ret->dst=NULL;
+    ret->xmap=NULL;
+    ret->xweight=NULL;
+    ret->mapw=ret->mapscale=0;
+    ret->rows=NULL;
+    ret->rowslen=0;
+    return ret;
+}
+
+void freeqlpost(qlpost **post)
+{
+    if(!post||!(*post))return;
+    freeqlpool(&(*post)->pool);
+    free((*post)->xmap);
+    free((*post)->xweight);
+    free((*post)->rows);
+    free(*post);
+    *post=NULL;
+}
+
+/*The i-th pixel of a raster in packed format fmt*/
+static inline unsigned int qlpostpixel(const qlraster *src,int i,int fmt)
+{
+    unsigned char rgb[3];
+    if(src->fmt==fmt)return ((const unsigned int*)src->data)[i];
+    qlgetpixel(src,i,rgb);
+    return fmt==QL_XRGB32?(rgb[0]<<16)|(rgb[1]<<8)|rgb[2]:(rgb[2]<<16)|(rgb[1]<<8)|rgb[0];
+}
+
+/*
+Blends two packed pixels: (a*(256-f)+b*f)/256 on every channel.
+Red and blue are done with a single multiplication, as the 8 bits between them leave room for the products.
+*/
+static inline unsigned int qlpostlerp(unsigned int a,unsigned int b,unsigned int f)
+{
+    unsigned int rb=((a&0xff00ff)*(256-f)+(b&0xff00ff)*f)>>8;
+    unsigned int g=((a&0xff00)*(256-f)+(b&0xff00)*f)>>8;
+    return (rb&0xff00ff)|(g&0xff00);
+}
+
+/*
+Splits output coordinate o of a scale-fold upscale into the source coordinate left of its centre (*i)
+and the weight (0-255) of the one after it (*f), clamping at the edges (len is the source length).
+*/
+static inline void qlpostsample(int o,int scale,int len,int *i,int *f)
+{
+    /*Centre of output pixel o in source pixels, times 256*/
+    int c=((2*o+1)*256)/(2*scale)-128;
+    if(c<0)c=0;
+    *i=c>>8;
+    *f=c&255;
+    if(*i>=len-1)
+    {
+        *i=len-1;
+        *f=0;
+    }
+}
+
+/*Darkens each pixel of a row by a random amount of up to noise/256*/
+static void qlpostnoise(qlpost *post,unsigned int *row,int y,int len)
+{
+    int x;
+    unsigned int seed=qlposthash(post->frame),f,p;
+    for(x=0;x<len;x++)
+    {
+        f=256-(((qlposthash(seed^(x+y*post->stride))&255)*post->noise)>>8);
+        p=row[x];
+        row[x]=((((p&0xff00ff)*f)>>8)&0xff00ff)|((((p&0xff00)*f)>>8)&0xff00);
+    }
+}
+
+/*Writes pixel p <n> times starting at row*/
+static inline void qlpostfill(unsigned int *row,unsigned int p,int n)
+{
+    int i=0;
+#ifdef __SSE2__
+    __m128i v=_mm_set1_epi32(p);
+    for(;i+4<=n;i+=4)_mm_storeu_si128((__m128i*)(row+i),v);
+#endif
+    for(;i<n;i++)row[i]=p;
+}
+
+static void qlpostnearest(void *arg,int job)
+{
+    qlpost *post=arg;
+    const qlraster *src=post->src;
+    int s=post->scale,xsize=src->w*s,ysize=src->h*s;
+    int x,y,y0=job*QL_POST_ROWS,y1=y0+QL_POST_ROWS<ysize?y0+QL_POST_ROWS:ysize;
+    unsigned int *row;
+    const unsigned int *srow;
+    for(y=y0;y<y1;y++)
+    {
+        row=post->dst+y*post->stride;
+        if(y%s&&y>y0)memcpy(row,row-post->stride,xsize*4);
+        else if(src->fmt==post->fmt)
+        {
+            srow=(const unsigned int*)src->data+(y/s)*src->w;
+            if(s==1)memcpy(row,srow,xsize*4);
+            else for(x=0;x<src->w;x++)qlpostfill(row+x*s,srow[x],s);
+        }
+        else for(x=0;x<src->w;x++)qlpostfill(row+x*s,qlpostpixel(src,x+(y/s)*src->w,post->fmt),s);
+    }
+    /*Noise is added afterwards, as rows copied from the one above must not share its grain*/
+    if(post->noise)
+        for(y=y0;y<y1;y++)qlpostnoise(post,post->dst+y*post->stride,y,xsize);
+}
+
+/*Horizontally filters source row sy into out*/
+static void qlposthrow(qlpost *post,int sy,unsigned int *out)
+{
+    const qlraster *src=post->src;
+    int x,i,xsize=src->w*post->scale;
+    for(x=0;x<xsize;x++)
+    {
+        i=post->xmap[x];
+        out[x]=qlpostlerp(qlpostpixel(src,i+sy*src->w,post->fmt),
+            qlpostpixel(src,(i+1<src->w?i+1:i)+sy*src->w,post->fmt),post->xweight[x]);
+    }
+}
+
+/*Blends rows a and b into out, with weight f (0-255) for b*/
+static void qlpostvrow(const unsigned int *a,const unsigned int *b,unsigned int *out,int len,int f)
+{
+    int x=0;
+#ifdef __SSE2__
+    __m128i zero=_mm_setzero_si128(),wa=_mm_set1_epi16(256-f),wb=_mm_set1_epi16(f),va,vb,lo,hi;
+    for(;x+4<=len;x+=4)
+    {
+        va=_mm_loadu_si128((const __m128i*)(a+x));
+        vb=_mm_loadu_si128((const __m128i*)(b+x));
+        /*Channels are widened to 16 bits, where a*(256-f)+b*f can't overflow*/
+        lo=_mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(va,zero),wa),_mm_mullo_epi16(_mm_unpacklo_epi8(vb,zero),wb));
+        hi=_mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(va,zero),wa),_mm_mullo_epi16(_mm_unpackhi_epi8(vb,zero),wb));
+        _mm_storeu_si128((__m128i*)(out+x),_mm_packus_epi16(_mm_srli_epi16(lo,8),_mm_srli_epi16(hi,8)));
+    }
+#endif
+    for(;x<len;x++)out[x]=qlpostlerp(a[x],b[x],f);
+}
+
+static void qlpostbilinear(void *arg,int job)
+{
+    qlpost *post=arg;
+    const qlraster *src=post->src;
+    int s=post->scale,xsize=src->w*s,ysize=src->h*s;
+    int y,sy,f,y0=job*QL_POST_ROWS,y1=y0+QL_POST_ROWS<ysize?y0+QL_POST_ROWS:ysize;
+    int cached[2]={-1,-1};
+    unsigned int *rows[2],*tmp;
+    rows[0]=post->rows+(size_t)job*2*xsize;
+    rows[1]=rows[0]+xsize;
+    for(y=y0;y<y1;y++)
+    {
+        qlpostsample(y,s,src->h,&sy,&f);
+        /*Consecutive output rows share source rows, so filtered rows are reused while they can be*/
+        if(cached[1]==sy&&cached[0]!=sy)
+        {
+            tmp=rows[0];
+            rows[0]=rows[1];
+            rows[1]=tmp;
+            cached[0]=sy;
+            cached[1]=-1;
+        }
+        if(cached[0]!=sy)
+        {
+            qlposthrow(post,sy,rows[0]);
+            cached[0]=sy;
+        }
+        if(f&&cached[1]!=sy+1)
+        {
+            qlposthrow(post,sy+1,rows[1]);
+            cached[1]=sy+1;
+        }
+        if(f)qlpostvrow(rows[0],rows[1],post->dst+y*post->stride,xsize,f);
+        else memcpy(post->dst+y*post->stride,rows[0],xsize*4);
+        if(post->noise)qlpostnoise(post,post->dst+y*post->stride,y,xsize);
+    }
+}
+
+void qlpostrun(qlpost *post,const qlraster *src,unsigned int *dst,int stride,int scale,int fmt)
+{
+    int x,jobs;
+    if(!post||!src||!dst||scale<=0)return;
+    QL_STAT_TIMER(t);
+    post->src=src;
+    post->dst=dst;
+    post->stride=stride;
+    post->scale=scale;
+    post->fmt=fmt==QL_XBGR32?QL_XBGR32:QL_XRGB32;
+    post->frame++;
+    if(post->filter==QL_POST_BILINEAR&&(post->mapw!=src->w||post->mapscale!=scale))
+    {
+        free(post->xmap);
+        free(post->xweight);
+        post->xmap=malloc(sizeof(int)*src->w*scale);
+        post->xweight=malloc(src->w*scale);
+        for(x=0;x<src->w*scale;x++)
+        {
+            int i,f;
+            qlpostsample(x,scale,src->w,&i,&f);
+            post->xmap[x]=i;
+            post->xweight[x]=f;
+        }
+        post->mapw=src->w;
+        post->mapscale=scale;
+    }
+    jobs=(src->h*scale+QL_POST_ROWS-1)/QL_POST_ROWS;
+    /*Each band filters its rows in its own scratch space, so no band waits for another*/
+    if(post->filter==QL_POST_BILINEAR&&post->rowslen<(size_t)jobs*2*src->w*scale)
+    {
+        free(post->rows);
+        post->rowslen=(size_t)jobs*2*src->w*scale;
+        post->rows=malloc(sizeof(unsigned int)*post->rowslen);
+    }
+    qlpoolrun(post->pool,jobs,post->filter==QL_POST_BILINEAR?qlpostbilinear:qlpostnearest,post);
+    QL_STAT_TIME(QL_STAGE_POST,t);
+}
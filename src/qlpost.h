@@ -0,0 +1,90 @@
+/*
+Quicklight raycaster-like renderer - Post-processing
+
+Copyright (c) 2020 Amélia O. F. da S.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#ifndef QLPOST
+#define QLPOST
+
+#include <stddef.h>
+#include "./quicklight.h"
+#include "./qlpool.h"
+
+/*Upscaling filters*/
+#define QL_POST_NEAREST 0
+#define QL_POST_BILINEAR 1
+
+/*Number of output rows handled by each post-processing job*/
+#define QL_POST_ROWS 16
+
+/*
+A post-processing stage, run between tracing (qlstep) and presentation.
+Upscales a raster into a buffer of packed 32-bit pixels and optionally adds film-grain noise,
+working on bands of rows in parallel. Everything is done in integer arithmetic (with SSE2 where available).
+*/
+typedef struct _qlpost{
+    qlpool *pool;/*Threads the bands of rows are spread over*/
+    int filter;/*Upscaling filter (QL_POST_NEAREST or QL_POST_BILINEAR)*/
+    unsigned char noise;/*Noise amplitude: each pixel is darkened by up to noise/255 (0 disables it)*/
+    unsigned int frame;/*Frame counter, used to seed the noise*/
+    const qlraster *src;/*Raster being processed*/
+    unsigned int *dst;/*Output pixels*/
+    int stride;/*Distance between output rows, in pixels*/
+    int scale;/*Upscaling factor*/
+    int fmt;/*Output pixel format (QL_XRGB32 or QL_XBGR32)*/
+    int *xmap;/*Source column of each output column (the left one, for bilinear filtering)*/
+    unsigned char *xweight;/*Weight (0-255) of the right source column of each output column*/
+    int mapw;/*Source width the column maps were built for*/
+    int mapscale;/*Scale the column maps were built for*/
+    unsigned int *rows;/*Scratch rows for bilinear filtering, two output rows wide for each band*/
+    size_t rowslen;/*Number of pixels allocated at rows*/
+} qlpost;
+/*
+Instantiates a qlpost object using <threads> threads (threads<=0 uses one per online CPU).
+One should free it with freeqlpost.
+*/
+qlpost *Qlpost(int threads);
+/*Frees a qlpost object*/
+void freeqlpost(qlpost **post);
+/*
+Upscales src scale-fold into dst (a buffer of (src->w*scale) x (src->h*scale) pixels in format fmt,
+with rows <stride> pixels apart), applying the stage's filter and noise.
+*/
+void qlpostrun(qlpost *post,const qlraster *src,unsigned int *dst,int stride,int scale,int fmt);
+
+/*
+Counter-based random numbers: returns a well-mixed hash of n.
+Hashing (frame, pixel) gives every pixel of every frame its own number without any shared generator state,
+so threads can draw them in any order.
+*/
+static inline unsigned int qlposthash(unsigned int n)
+{
+    n^=n>>16;
+    n*=0x7feb352dU;
+    n^=n>>15;
+    n*=0x846ca68bU;
+    n^=n>>16;
+    return n;
+}
+
+#endif
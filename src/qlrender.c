@@ -1,6 +1,11 @@
 #include <stdio.h>
+#include <string.h>
 #include <math.h>
+#include <fcntl.h>
+#include <errno.h>
 #include "./qlrender.h"
+#include "./qlstats.h"
+#include "./qlpost.h"
 #define QL_STRINGIZE(x) #x
 #define QL_CUSTOM_NAME(x) QL_STRINGIZE(x)
 #ifdef QL_CUSTOM_STEP
@@ -42,6 +47,46 @@ The methods used here are basically exact copies of the ones available there.
 (https://www3.nd.edu/~dthain/courses/cse20211/fall2013/gfx/)
 */
 
+/*
+Native 32-bit pixel format of a visual (or QL_RGB24 if its pixels aren't 8-bit channels in a 32-bit word).
+*/
+static int qlvisualformat(Display *display,Visual *visual)
+{
+    int i,n,depth=DefaultDepth(display,0),bpp=0;
+    XPixmapFormatValues *formats=XListPixmapFormats(display,&n);
+    if(!formats)return QL_RGB24;
+    for(i=0;i<n;i++)if(formats[i].depth==depth)bpp=formats[i].bits_per_pixel;
+    XFree(formats);
+    if(bpp!=32)return QL_RGB24;
+    if(visual->red_mask==0xff0000&&visual->green_mask==0xff00&&visual->blue_mask==0xff)return QL_XRGB32;
+    if(visual->red_mask==0xff&&visual->green_mask==0xff00&&visual->blue_mask==0xff0000)return QL_XBGR32;
+    return QL_RGB24;
+}
+
+/*
+Sets up drawing through an XImage when the visual takes packed 32-bit pixels,
+switching the camera's raster to that format so frames need no conversion.
+*/
+static void qlscreenimage(qlscreen *screen,Visual *visual)
+{
+    int one=1,fmt=qlvisualformat(screen->display,visual);
+    int w=screen->cam->image->w*screen->s,h=screen->cam->image->h*screen->s;
+    if(fmt==QL_RGB24)return;
+    screen->buf=malloc(w*h*4);
+    screen->ximage=XCreateImage(screen->display,visual,DefaultDepth(screen->display,0),ZPixmap,0,(char*)screen->buf,w,h,32,w*4);
+    if(!screen->ximage)
+    {
+        free(screen->buf);
+        screen->buf=NULL;
+        return;
+    }
+    /*Pixels are written as native-endian words*/
+    screen->ximage->byte_order=*(char*)&one?LSBFirst:MSBFirst;
+    screen->fmt=fmt;
+    screen->post=Qlpost(0);
+    qlrastersetformat(screen->cam->image,fmt);
+}
+
 qlscreen* Qlscreen(qlcamera *cam,int scale,const char* title)
 {
     qlscreen* ret;
@@ -50,9 +95,30 @@ qlscreen* Qlscreen(qlcamera *cam,int scale,const char* title)
     ret->s=scale;
     ret->display=XOpenDisplay(0);
     ret->cam=cam;
-    if(!ret->display)return NULL;
+    if(!ret->display)
+    {
+        free(ret);
+        return NULL;
+    }
     Visual *visual = DefaultVisual(ret->display,0);
     fast_color_mode = visual && visual->class==TrueColor?1:0;
+    ret->ximage=NULL;
+    ret->buf=NULL;
+    ret->post=NULL;
+    ret->fmt=QL_RGB24;
+    if(fast_color_mode)qlscreenimage(ret,visual);
+    ret->evcap=64;
+    ret->events=malloc(ret->evcap);
+    ret->evhead=ret->evcount=0;
+    ret->expose=0;
+    ret->onframe=NULL;
+    ret->onframearg=NULL;
+    if(pipe(ret->wake))ret->wake[0]=ret->wake[1]=-1;
+    else
+    {
+        fcntl(ret->wake[0],F_SETFL,O_NONBLOCK);
+        fcntl(ret->wake[1],F_SETFL,O_NONBLOCK);
+    }
     int blackColor = BlackPixel(ret->display, DefaultScreen(ret->display));
     int whiteColor = WhitePixel(ret->display, DefaultScreen(ret->display));
     ret->window = XCreateSimpleWindow(ret->display, DefaultRootWindow(ret->display), 0, 0, cam->image->w*scale, cam->image->h*scale, 0, blackColor, blackColor);
@@ -60,7 +126,7 @@ qlscreen* Qlscreen(qlcamera *cam,int scale,const char* title)
     attr.backing_store = Always;
     XChangeWindowAttributes(ret->display,ret->window,CWBackingStore,&attr);
     XStoreName(ret->display,ret->window,title);
-    XSelectInput(ret->display, ret->window, StructureNotifyMask|KeyPressMask|ButtonPressMask);
+    XSelectInput(ret->display, ret->window, StructureNotifyMask|KeyPressMask|ButtonPressMask|ExposureMask);
     XMapWindow(ret->display,ret->window);
     ret->gc = XCreateGC(ret->display, ret->window, 0, 0);
     if(!colormap)colormap = DefaultColormap(ret->display,0);
@@ -74,24 +140,71 @@ qlscreen* Qlscreen(qlcamera *cam,int scale,const char* title)
     return ret;
 }
 
+void freeqlscreen(qlscreen **screen)
+{
+    if(!screen||!(*screen))return;
+    /*XDestroyImage frees the pixels (buf) too*/
+    if((*screen)->ximage)XDestroyImage((*screen)->ximage);
+    freeqlpost(&(*screen)->post);
+    free((*screen)->events);
+    if((*screen)->wake[0]>=0)
+    {
+        close((*screen)->wake[0]);
+        close((*screen)->wake[1]);
+    }
+    XFreeGC((*screen)->display,(*screen)->gc);
+    XDestroyWindow((*screen)->display,(*screen)->window);
+    XCloseDisplay((*screen)->display);
+    free(*screen);
+    *screen=NULL;
+}
+
 void qlrender(qlscreen* screen,qltri** world)
 {
-    int x,y,xx,yy,xsize,ysize,xlen,ylen,r,g,b;
     if(!screen||!world||!world[0])return;
-    xlen=screen->cam->image->w;
-    ylen=screen->cam->image->h;
-    xsize=xlen*screen->s;
-    ysize=ylen*screen->s;
     qlstep(screen->cam,(const qltri**)world);
+    qlpresent(screen);
+}
+
+/*
+Draws the camera's image scaled up screen->s-fold, multiplying each drawn pixel by a random factor
+in [1-rnd/255,1] when rnd isn't 0.
+*/
+static void qldraw(qlscreen* screen,unsigned char rnd)
+{
+    int x,y,xsize,ysize,xlen,r,g,b;
+    unsigned char rgb[3];
+    double rn=1;
+    qlraster *image=screen->cam->image;
+    xlen=image->w;
+    xsize=xlen*screen->s;
+    ysize=image->h*screen->s;
+    if(screen->ximage)
+    {
+        /*The raster already holds the visual's pixel values, so it can be drawn as it is*/
+        if(image->fmt==screen->fmt&&screen->s==1&&!rnd)
+            screen->ximage->data=(char*)image->data;
+        else
+        {
+            screen->post->noise=rnd;
+            qlpostrun(screen->post,image,screen->buf,xsize,screen->s,screen->fmt);
+        }
+        QL_STAT_TIMER(t);
+        XPutImage(screen->display,screen->window,screen->gc,screen->ximage,0,0,0,0,xsize,ysize);
+        if(screen->ximage->data==(char*)image->data)screen->ximage->data=(char*)screen->buf;
+        QL_STAT_TIME(QL_STAGE_PRESENT,t);
+        return;
+    }
+    QL_STAT_TIMER(t);
     for(x=0;x<xsize;x++)
     {
         for(y=0;y<ysize;y++)
         {
-            xx=floor(x/screen->s);
-            yy=floor(y/screen->s);
-            r=screen->cam->image->data[(xx+yy*xlen)*3];
-            g=screen->cam->image->data[(xx+yy*xlen)*3+1];
-            b=screen->cam->image->data[(xx+yy*xlen)*3+2];
+            if(rnd)rn=1-(((rand()%256)/255.0)*rnd)/255.0;
+            qlgetpixel(image,x/screen->s+(y/screen->s)*xlen,rgb);
+            r=rgb[0]*rn;
+            g=rgb[1]*rn;
+            b=rgb[2]*rn;
 
             XColor color;
             if(fast_color_mode) {
@@ -107,57 +220,144 @@ void qlrender(qlscreen* screen,qltri** world)
             XDrawPoint(screen->display,screen->window,screen->gc,x,y);
         }
     }
+    QL_STAT_TIME(QL_STAGE_PRESENT,t);
+}
+
+void qlpresent(qlscreen* screen)
+{
+    if(!screen)return;
+    qldraw(screen,0);
+    qlstatsframe();
 }
 
 void qlrendernoise(qlscreen* screen,qltri** world,unsigned char rnd)
 {
-    int x,y,xx,yy,xsize,ysize,xlen,ylen,r,g,b;
     if(!screen||!world||!world[0])return;
-    xlen=screen->cam->image->w;
-    ylen=screen->cam->image->h;
-    xsize=xlen*screen->s;
-    ysize=ylen*screen->s;
     qlstep(screen->cam,(const qltri**)world);
-    double rn;
-    for(x=0;x<xsize;x++)
+    qldraw(screen,rnd);
+    qlstatsframe();
+}
+
+/*Appends an input event to the screen's queue, growing it when it's full*/
+static void qlqueueevent(qlscreen *screen,char c)
+{
+    int i;
+    char *events;
+    if(screen->evcount==screen->evcap)
     {
-        for(y=0;y<ysize;y++)
-        {
-            rn=1-(((rand()%256)/255.0)*rnd)/255.0;
-            xx=floor(x/screen->s);
-            yy=floor(y/screen->s);
-            r=(unsigned char)((double)screen->cam->image->data[(xx+yy*xlen)*3])*rn;
-            g=(unsigned char)((double)screen->cam->image->data[(xx+yy*xlen)*3+1])*rn;
-            b=(unsigned char)((double)screen->cam->image->data[(xx+yy*xlen)*3+2])*rn;
+        events=malloc(screen->evcap*2);
+        for(i=0;i<screen->evcount;i++)events[i]=screen->events[(screen->evhead+i)%screen->evcap];
+        free(screen->events);
+        screen->events=events;
+        screen->evhead=0;
+        screen->evcap*=2;
+    }
+    screen->events[(screen->evhead+screen->evcount++)%screen->evcap]=c;
+}
 
-            XColor color;
-            if(fast_color_mode) {
-                color.pixel = ((b&0xff) | ((g&0xff)<<8) | ((r&0xff)<<16) );
-            } else {
-                color.pixel = 0;
-                color.red = r<<8;
-                color.green = g<<8;
-                color.blue = b<<8;
-                XAllocColor(screen->display,colormap,&color);
-            }
-            XSetForeground(screen->display, screen->gc, color.pixel);
-            XDrawPoint(screen->display,screen->window,screen->gc,x,y);
+/*Moves every X event waiting on the connection to the screen's queue*/
+static void qlpollevents(qlscreen *screen)
+{
+    XEvent event;
+    KeySym sym;
+    while(XPending(screen->display))
+    {
+        XNextEvent(screen->display,&event);
+        if(event.type==KeyPress)
+        {
+            /*Keys with a Latin-1 keysym are their charcode, and a few others their ASCII control code.
+            The rest are dropped (truncating them would alias them, e.g. XK_Left to 'Q')*/
+            sym=XLookupKeysym(&event.xkey,0);
+            if(sym>0&&sym<256)qlqueueevent(screen,sym);
+            else if(sym==XK_Escape)qlqueueevent(screen,27);
+            else if(sym==XK_BackSpace)qlqueueevent(screen,8);
+            else if(sym==XK_Tab)qlqueueevent(screen,9);
+            else if(sym==XK_Return||sym==XK_KP_Enter)qlqueueevent(screen,13);
         }
+        else if(event.type==ButtonPress)qlqueueevent(screen,event.xbutton.button);
+        else if(event.type==Expose&&event.xexpose.count==0)screen->expose=1;
     }
 }
 
 char qlevent(qlscreen *screen)
 {
-	XEvent event;
-	if(XPending(screen->display))
-		while(XPending(screen->display))
-			XNextEvent(screen->display,&event);
-	else return 0;
-
-	if(event.type==KeyPress) {
-		return XLookupKeysym(&event.xkey,0);
-	} else if(event.type==ButtonPress) {
-		return event.xbutton.button;
-	}
-    return 0;
-}
\ No newline at end of file
+    char c;
+    if(!screen)return 0;
+    qlpollevents(screen);
+    if(!screen->evcount)return 0;
+    c=screen->events[screen->evhead];
+    screen->evhead=(screen->evhead+1)%screen->evcap;
+    screen->evcount--;
+    return c;
+}
+
+void qlscreendirty(qlscreen *screen)
+{
+    char c=1;
+    if(!screen||screen->wake[1]<0)return;
+    /*If the pipe is full the loop is already due to wake up*/
+    if(write(screen->wake[1],&c,1)<0){}
+}
+
+int qlloop(qlscreen *screen,qltri** world,int (*onevent)(qlscreen *screen,char c,void *arg),void *arg,double fps)
+{
+    qlcamerastate last,now;
+    unsigned long long lastframe=0,period=fps>0?1e9/fps:0,t;
+    char c,dirty=1,buf[64];
+    int ret,fd,maxfd;
+    fd_set fds;
+    struct timeval timeout;
+    if(!screen)return -1;
+    fd=ConnectionNumber(screen->display);
+    maxfd=fd>screen->wake[0]?fd:screen->wake[0];
+    qlgetcamerastate(screen->cam,&last);
+    for(;;)
+    {
+        /*Drain the queue by its count: the event's charcode says nothing about whether there are more*/
+        qlpollevents(screen);
+        while(screen->evcount)
+        {
+            c=qlevent(screen);
+            if(onevent)
+            {
+                if((ret=onevent(screen,c,arg)))return ret;
+            }
+            else qlcameractl(screen->cam,c);
+        }
+        if(screen->wake[0]>=0)
+            while(read(screen->wake[0],buf,sizeof(buf))>0)dirty=1;
+        qlgetcamerastate(screen->cam,&now);
+        if(memcmp(&now,&last,sizeof(qlcamerastate)))dirty=1;
+        t=qlstatsnow();
+        if(dirty&&t-lastframe>=period)
+        {
+            if(screen->onframe)screen->onframe(screen,0,screen->onframearg);
+            qlrender(screen,world);
+            if(screen->onframe)screen->onframe(screen,1,screen->onframearg);
+            last=now;
+            lastframe=t;
+            dirty=0;
+            screen->expose=0;
+        }
+        else if(screen->expose)
+        {
+            qlpresent(screen);
+            screen->expose=0;
+        }
+        /*Xlib may already hold events read from the connection, which select wouldn't see*/
+        XFlush(screen->display);
+        if(XPending(screen->display)||screen->evcount)continue;
+        FD_ZERO(&fds);
+        FD_SET(fd,&fds);
+        if(screen->wake[0]>=0)FD_SET(screen->wake[0],&fds);
+        if(dirty)
+        {
+            /*A frame is due but capped: sleep until it's allowed*/
+            t=lastframe+period-qlstatsnow();
+            if(t>period)t=0;
+            timeout.tv_sec=t/1000000000ULL;
+            timeout.tv_usec=(t%1000000000ULL)/1000;
+        }
+        if(select(maxfd+1,&fds,NULL,NULL,dirty?&timeout:NULL)<0&&errno!=EINTR)return -1;
+    }
+}
@@ -32,11 +32,12 @@ SOFTWARE.
 #include <sys/select.h>
 #include <time.h>
 #include "quicklight.h"
+#include "qlpost.h"
 
 /*Data structures and allocation functions*/
 
-Colormap colormap;
-int fast_color_mode;
+extern Colormap colormap;
+extern int fast_color_mode;
 
 /*
 A qlrender screen instance (opens a X11 instance)
@@ -47,19 +48,58 @@ typedef struct _qlscreen{
     qlcamera *cam;
     GC gc;
     int s;
+    XImage *ximage;/*Image frames are drawn to, when the visual takes packed 32-bit pixels (NULL otherwise)*/
+    unsigned int *buf;/*Pixels of ximage*/
+    int fmt;/*Pixel format of ximage*/
+    qlpost *post;/*Post-processing stage that upscales frames into ximage (set its filter to choose the upscaling filter)*/
+    char *events;/*Queue of input events not read yet (a ring buffer that grows when full)*/
+    int evcap;/*Size of the event queue*/
+    int evhead;/*Index of the oldest queued event*/
+    int evcount;/*Number of queued events*/
+    char expose;/*Whether the window must be redrawn*/
+    int wake[2];/*Pipe qlscreendirty writes to, to wake up qlloop*/
+    void (*onframe)(struct _qlscreen *screen,char done,void *arg);/*If set, qlloop calls it before tracing each frame (done=0) and after presenting it (done=1)*/
+    void *onframearg;/*Argument passed to onframe*/
 } qlscreen;
 /*
 Instantiates a new screen bound to camera cam and a new X11 display. It will scale the image up <int scale>-fold.
+If the display's visual takes packed 32-bit pixels, the camera's raster is switched to that format
+(see qlrastersetformat), so traced pixels can be drawn without any conversion.
 */
 qlscreen* Qlscreen(qlcamera *cam,int scale,const char* title);
+/*Closes a screen's window and display (but doesn't free its camera)*/
+void freeqlscreen(qlscreen **screen);
 
 /*Renders a frame. qltri** world is a list of all the triangles in the scene*/
 void qlrender(qlscreen* screen,qltri** world);
 
+/*Draws the camera's current image to the screen without tracing it again*/
+void qlpresent(qlscreen* screen);
+
 /*Renders a frame. qltri** world is a list of all the triangles in the scene. Randomizes the shadows so it looks more like a camera*/
 void qlrendernoise(qlscreen* screen,qltri** world,unsigned char rnd);
 
-/*Returns the charcode of the last event (or 0 if there are no events in the buffer)*/
+/*
+Returns the charcode of the oldest input event not read yet (or 0 if there are none).
+Events are queued, so none are lost between calls. Only key presses with a Latin-1 keysym (1-255), Escape (27),
+BackSpace (8), Tab (9) and Return (13), and mouse buttons are queued, so a queued event is never 0.
+*/
 char qlevent(qlscreen *screen);
 
+/*
+Marks the scene as changed, so qlloop renders a new frame even if the camera didn't move.
+May be called from any thread.
+*/
+void qlscreendirty(qlscreen *screen);
+
+/*
+Render-on-demand event loop.
+Blocks until there are input events, the scene is marked as changed (qlscreendirty) or the window must be redrawn.
+Each input event is passed, in order, to onevent(screen,c,arg) (or to qlcameractl if onevent is NULL).
+A new frame is only rendered when the camera or the scene changed, at most fps times per second (fps<=0 doesn't cap it).
+The screen's onframe hook, if set, runs around each rendered frame (to update world, for instance).
+Returns when onevent returns non-zero (returning that value) or when the X connection fails (returning -1).
+*/
+int qlloop(qlscreen *screen,qltri** world,int (*onevent)(qlscreen *screen,char c,void *arg),void *arg,double fps);
+
 #endif
\ No newline at end of file
@@ -0,0 +1,224 @@
+#include "./qlreplay.h"
+#include "./qlstats.h"
+#include <stdlib.h>
+#include <string.h>
+/*
+Copyright (c) 2020 Amélia O. F. da S.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+static void qlwritestate(FILE *f,const qlcamerastate *s)
+{
+    fprintf(f,"%.17g %.17g %.17g %.17g %.17g %.17g %.17g %.17g %.17g %.17g %.17g",
+        s->pos.x,s->pos.y,s->pos.z,s->dir.x,s->dir.y,s->dir.z,s->roll,s->fl,s->w,s->h,s->depth);
+}
+/*Reads a state from p. Returns a pointer past it, or NULL if it's malformed.*/
+static char *qlreadstate(char *p,qlcamerastate *s)
+{
+    double *fields[]={&s->pos.x,&s->pos.y,&s->pos.z,&s->dir.x,&s->dir.y,&s->dir.z,&s->roll,&s->fl,&s->w,&s->h,&s->depth};
+    char *end;
+    int i;
+    memset(s,0,sizeof(qlcamerastate));
+    for(i=0;i<11;i++)
+    {
+        *fields[i]=strtod(p,&end);
+        if(end==p)return NULL;
+        p=end;
+    }
+    return p;
+}
+static int qlhexdigit(char c)
+{
+    if(c>='0'&&c<='9')return c-'0';
+    if(c>='a'&&c<='f')return c-'a'+10;
+    if(c>='A'&&c<='F')return c-'A'+10;
+    return -1;
+}
+
+unsigned long long qlrasterchecksum(const qlraster *raster)
+{
+    unsigned long long h=14695981039346656037ULL;
+    size_t i,s;
+    if(!raster)return 0;
+    s=(size_t)raster->w*raster->h*raster->s;
+    for(i=0;i<s;i++)
+    {
+        h^=raster->data[i];
+        h*=1099511628211ULL;
+    }
+    return h;
+}
+
+qlrecord *Qlrecord(const char *fname,const qlcamera *camera)
+{
+    qlrecord *ret;
+    qlcamerastate state;
+    FILE *f;
+    if(!camera)return NULL;
+    f=fopen(fname,"w");
+    if(!f)return NULL;
+    qlgetcamerastate(camera,&state);
+    fprintf(f,"QLTRACE1 %d %d %d\n",camera->image->w,camera->image->h,camera->image->fmt);
+    qlwritestate(f,&state);
+    fprintf(f," %.17g\n",camera->znorm);
+    ret=malloc(sizeof(qlrecord));
+    ret->f=f;
+    ret->cap=64;
+    ret->events=malloc(ret->cap);
+    ret->nevents=0;
+    ret->frames=0;
+    return ret;
+}
+
+void qlrecordevent(qlrecord *rec,char c)
+{
+    if(!rec)return;
+    if(rec->nevents==rec->cap)
+    {
+        rec->cap*=2;
+        rec->events=realloc(rec->events,rec->cap);
+    }
+    rec->events[rec->nevents++]=c;
+}
+
+int qlrecordframe(qlrecord *rec,const qlcamera *camera)
+{
+    int i;
+    qlcamerastate state;
+    if(!rec||!camera)return -1;
+    qlgetcamerastate(camera,&state);
+    fprintf(rec->f,"%016llx ",qlrasterchecksum(camera->image));
+    for(i=0;i<rec->nevents;i++)fprintf(rec->f,"%02x",(unsigned char)rec->events[i]);
+    if(!rec->nevents)fprintf(rec->f,"-");
+    fprintf(rec->f," ");
+    qlwritestate(rec->f,&state);
+    rec->nevents=0;
+    rec->frames++;
+    return fprintf(rec->f,"\n")<0?-1:0;
+}
+
+void freeqlrecord(qlrecord **rec)
+{
+    if(!rec||!(*rec))return;
+    fclose((*rec)->f);
+    free((*rec)->events);
+    free(*rec);
+    *rec=NULL;
+}
+
+qlreplay *Qlreplay(const char *fname)
+{
+    qlreplay *ret;
+    qlreplayframe *frame;
+    char *line=NULL,*p,*end;
+    size_t linesize=0;
+    int cap=64,i,hi,lo;
+    FILE *f=fopen(fname,"r");
+    if(!f)return NULL;
+    ret=malloc(sizeof(qlreplay));
+    ret->n=0;
+    ret->frames=malloc(sizeof(qlreplayframe)*cap);
+    ret->mode=QL_REPLAY_EVENTS;
+    ret->next=0;
+    ret->mismatches=0;
+    ret->t=0;
+    if(getline(&line,&linesize,f)<0||sscanf(line,"QLTRACE1 %d %d %d",&ret->w,&ret->h,&ret->fmt)!=3||
+        getline(&line,&linesize,f)<0||!(p=qlreadstate(line,&ret->start)))goto fail;
+    ret->znorm=strtod(p,NULL);
+    while(getline(&line,&linesize,f)>0)
+    {
+        if(ret->n==cap)
+        {
+            cap*=2;
+            ret->frames=realloc(ret->frames,sizeof(qlreplayframe)*cap);
+        }
+        frame=&ret->frames[ret->n];
+        frame->sum=strtoull(line,&end,16);
+        if(end==line||*end!=' ')goto fail;
+        p=end+1;
+        end=strchr(p,' ');
+        if(!end)goto fail;
+        frame->nevents=*p=='-'?0:(end-p)/2;
+        frame->events=malloc(frame->nevents+1);
+        ret->n++;
+        for(i=0;i<frame->nevents;i++)
+        {
+            hi=qlhexdigit(p[i*2]);
+            lo=qlhexdigit(p[i*2+1]);
+            if(hi<0||lo<0)goto fail;
+            frame->events[i]=hi*16+lo;
+        }
+        if(!qlreadstate(end,&frame->state))goto fail;
+        frame->replayed=0;
+        frame->ns=0;
+    }
+    free(line);
+    fclose(f);
+    return ret;
+fail:
+    free(line);
+    fclose(f);
+    freeqlreplay(&ret);
+    return NULL;
+}
+
+void qlreplaystart(qlreplay *replay,qlcamera *camera,char mode)
+{
+    if(!replay||!camera)return;
+    replay->mode=mode;
+    replay->next=0;
+    replay->mismatches=0;
+    qlsetcamerastate(camera,&replay->start);
+    camera->znorm=replay->znorm;
+}
+
+int qlreplaynext(qlreplay *replay,qlcamera *camera)
+{
+    int i;
+    qlreplayframe *frame;
+    if(!replay||!camera||replay->next>=replay->n)return -1;
+    frame=&replay->frames[replay->next];
+    replay->t=qlstatsnow();
+    if(replay->mode==QL_REPLAY_STATES)qlsetcamerastate(camera,&frame->state);
+    else for(i=0;i<frame->nevents;i++)qlcameractl(camera,frame->events[i]);
+    return replay->next++;
+}
+
+int qlreplaydone(qlreplay *replay,const qlcamera *camera)
+{
+    qlreplayframe *frame;
+    if(!replay||!camera||!replay->next)return 1;
+    frame=&replay->frames[replay->next-1];
+    frame->ns=qlstatsnow()-replay->t;
+    frame->replayed=qlrasterchecksum(camera->image);
+    if(frame->replayed==frame->sum)return 0;
+    replay->mismatches++;
+    return 1;
+}
+
+void freeqlreplay(qlreplay **replay)
+{
+    int i;
+    if(!replay||!(*replay))return;
+    for(i=0;i<(*replay)->n;i++)free((*replay)->frames[i].events);
+    free((*replay)->frames);
+    free(*replay);
+    *replay=NULL;
+}
@@ -0,0 +1,119 @@
+/*
+Quicklight raycaster-like renderer - Session recording and replay
+
+Copyright (c) 2020 Amélia O. F. da S.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef QLREPLAY
+#define QLREPLAY
+
+#include <stdio.h>
+#include "./quicklight.h"
+
+/*
+A session is recorded frame by frame: the camera control events applied since the previous frame, the camera's
+state the frame was rendered with, and a checksum of the rendered image. Replaying it feeds either the events
+(through qlcameractl) or the states to a camera, headlessly and as fast as frames can be rendered, then checksums
+and times every frame, so that any change to the renderer can be checked and benchmarked on the same flythrough.
+
+File layout (text, one line each):
+"QLTRACE1" width height format (of the recorded raster)
+The starting camera state (pos, dir, roll, fl, w, h, depth) and znorm
+For each frame: the image's checksum (16 hex digits), the events (two hex digits each, or "-" if there were none),
+and the camera state
+Doubles are written with 17 significant digits, so they are read back exactly.
+*/
+
+/*Replay modes*/
+#define QL_REPLAY_EVENTS 0 /*Apply the recorded events with qlcameractl*/
+#define QL_REPLAY_STATES 1 /*Set the recorded camera states*/
+
+/*A session being recorded*/
+typedef struct _qlrecord{
+    FILE *f;/*The trace file*/
+    char *events;/*Events since the last frame*/
+    int nevents;/*Number of events in events*/
+    int cap;/*Size of events*/
+    int frames;/*Frames recorded so far*/
+} qlrecord;
+/*
+Starts recording to fname, from the camera's current state.
+Returns NULL on errors. One should close it with freeqlrecord.
+*/
+qlrecord *Qlrecord(const char *fname,const qlcamera *camera);
+/*Records an event passed to qlcameractl (call it along with qlcameractl, e.g. in qlloop's onevent)*/
+void qlrecordevent(qlrecord *rec,char c);
+/*
+Records a frame once the camera's image is rendered (e.g. from the screen's onframe hook, with done=1).
+Returns 0, or -1 if the file couldn't be written.
+*/
+int qlrecordframe(qlrecord *rec,const qlcamera *camera);
+/*Closes a recording*/
+void freeqlrecord(qlrecord **rec);
+
+/*A recorded frame*/
+typedef struct _qlreplayframe{
+    char *events;/*Events applied before the frame*/
+    int nevents;/*Number of events*/
+    qlcamerastate state;/*Camera state the frame was rendered with*/
+    unsigned long long sum;/*Checksum of the recorded image*/
+    unsigned long long replayed;/*Checksum of the image when replayed*/
+    unsigned long long ns;/*Time the replayed frame took, from qlreplaynext to qlreplaydone*/
+} qlreplayframe;
+
+/*A recorded session, loaded for replay*/
+typedef struct _qlreplay{
+    int w;/*Width of the recorded raster*/
+    int h;/*Height of the recorded raster*/
+    int fmt;/*Pixel format of the recorded raster*/
+    qlcamerastate start;/*Camera state when the recording started*/
+    double znorm;/*The camera's znorm when the recording started (qlshade depends on it)*/
+    int n;/*Number of frames*/
+    qlreplayframe *frames;/*The frames*/
+    char mode;/*QL_REPLAY_* mode of the current replay*/
+    int next;/*Index of the next frame to replay*/
+    int mismatches;/*Frames of the current replay whose checksum differs from the recorded one*/
+    unsigned long long t;/*When the current frame started*/
+} qlreplay;
+/*Loads a recorded session. Returns NULL if the file can't be read or is malformed. Free it with freeqlreplay.*/
+qlreplay *Qlreplay(const char *fname);
+/*
+Starts a replay in the given mode, setting the camera to the recorded starting state and znorm.
+The camera's raster should have the recorded size and format, or no checksum will match.
+*/
+void qlreplaystart(qlreplay *replay,qlcamera *camera,char mode);
+/*
+Moves the camera to the next frame and starts timing it. Returns the frame's index, or -1 at the end of the session.
+Render the frame in any way, then call qlreplaydone.
+*/
+int qlreplaynext(qlreplay *replay,qlcamera *camera);
+/*
+Stops timing the current frame and checksums the camera's image.
+Returns 0 if the checksum matches the recorded one and 1 otherwise.
+*/
+int qlreplaydone(qlreplay *replay,const qlcamera *camera);
+/*Frees a recorded session*/
+void freeqlreplay(qlreplay **replay);
+
+/*Checksum (64-bit FNV-1a) of a raster's pixels*/
+unsigned long long qlrasterchecksum(const qlraster *raster);
+
+#endif
@@ -0,0 +1,276 @@
+#include "./qlscene.h"
+#include "./qlvect.h"
+#include "./qlstats.h"
+#include <stdlib.h>
+#include <math.h>
+/*
+Copyright (c) 2020 Amélia O. F. da S.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+void qlscenebounds(const qltri *t,qlvect *center,double *radius)
+{
+    qlvect d;
+    double r;
+    /*The centroid isn't the tightest centre, but it's cheap and close enough for culling*/
+    qlvectsum(&t->a,&t->b,center);
+    qlvectsum(center,&t->c,center);
+    qlvectscale(center,1.0/3,center);
+    qlvectsub(&t->a,center,&d);
+    r=qlscproduct(&d,&d);
+    qlvectsub(&t->b,center,&d);
+    if(qlscproduct(&d,&d)>r)r=qlscproduct(&d,&d);
+    qlvectsub(&t->c,center,&d);
+    if(qlscproduct(&d,&d)>r)r=qlscproduct(&d,&d);
+    *radius=sqrt(r);
+}
+
+qlscene *Qlscene(qltri **tris)
+{
+    qlscene *ret;
+    int i;
+    if(!tris)return NULL;
+    ret=malloc(sizeof(qlscene));
+    ret->tris=tris;
+    for(ret->len=0;tris[ret->len];ret->len++){}
+    ret->centers=malloc(sizeof(qlvect)*(ret->len+1));
+    ret->radii=malloc(sizeof(double)*(ret->len+1));
+    for(i=0;i<ret->len;i++)qlscenebounds(tris[i],&ret->centers[i],&ret->radii[i]);
+    return ret;
+}
+
+void freeqlscene(qlscene **scene)
+{
+    if(!scene||!(*scene))return;
+    free((*scene)->centers);
+    free((*scene)->radii);
+    free(*scene);
+    *scene=NULL;
+}
+
+/*
+The camera's rays start on the image plane and diverge from the focal point behind it,
+so they all lie inside a pyramid with its apex at the focal point, cut by the image plane.
+A triangle is culled when its bounding sphere is fully outside one of the pyramid's planes,
+or farther than any ray reaches.
+*/
+void qlcamerafrustum(const qlcamera *camera,qlfrustum *frustum)
+{
+    qlvect ex,ey,dir,focal,corner[4],d;
+    int i;
+    if(!camera||!frustum)return;
+    qlcamerabasis(camera,&ex,&ey);
+    dir=camera->dir;
+    qlvectnormalize(&dir);
+    qlvectscale(&dir,-camera->fl,&focal);
+    qlvectsum(&camera->pos,&focal,&focal);
+    /*Corners of the image plane, relative to the focal point*/
+    for(i=0;i<4;i++)
+    {
+        qlvectscale(&ex,(i&1?0.5:-0.5)*camera->w,&d);
+        qlvectsub(&camera->pos,&focal,&corner[i]);
+        qlvectsum(&corner[i],&d,&corner[i]);
+        qlvectscale(&ey,(i&2?0.5:-0.5)*camera->h,&d);
+        qlvectsum(&corner[i],&d,&corner[i]);
+    }
+    /*Side planes through the focal point and two adjacent corners (0-1-3-2 goes around the image)*/
+    qlvectproduct(&corner[0],&corner[1],&frustum->normal[0]);
+    qlvectproduct(&corner[1],&corner[3],&frustum->normal[1]);
+    qlvectproduct(&corner[3],&corner[2],&frustum->normal[2]);
+    qlvectproduct(&corner[2],&corner[0],&frustum->normal[3]);
+    /*Image plane*/
+    qlvectproduct(&ex,&ey,&frustum->normal[4]);
+    for(i=0;i<5;i++)
+    {
+        qlvectnormalize(&frustum->normal[i]);
+        frustum->offset[i]=qlscproduct(&frustum->normal[i],i<4?&focal:&camera->pos);
+        /*Point the normals inwards, using a point inside the pyramid*/
+        qlvectsub(&camera->pos,&focal,&d);
+        qlvectscale(&d,2,&d);
+        qlvectsum(&focal,&d,&d);
+        if(qlscproduct(&frustum->normal[i],&d)<frustum->offset[i])
+        {
+            qlvectscale(&frustum->normal[i],-1,&frustum->normal[i]);
+            frustum->offset[i]=-frustum->offset[i];
+        }
+    }
+    frustum->pos=camera->pos;
+    frustum->reach=camera->depth+sqrt(qlscproduct(&ex,&ex))*camera->w/2+sqrt(qlscproduct(&ey,&ey))*camera->h/2;
+}
+
+char qlfrustumsphere(const qlfrustum *frustum,const qlvect *center,double radius)
+{
+    qlvect d;
+    int j;
+    for(j=0;j<5;j++)
+        if(qlscproduct(&frustum->normal[j],center)-frustum->offset[j]<-radius)return 0;
+    qlvectsub(center,&frustum->pos,&d);
+    return sqrt(qlscproduct(&d,&d))-radius<=frustum->reach;
+}
+
+int qlscenecull(const qlscene *scene,const qlcamera *camera,const qltri **out)
+{
+    qlfrustum frustum;
+    int i,n=0;
+    if(!scene||!camera||!out)return 0;
+    qlcamerafrustum(camera,&frustum);
+    for(i=0;i<scene->len;i++)
+        if(qlfrustumsphere(&frustum,&scene->centers[i],scene->radii[i]))out[n++]=scene->tris[i];
+    out[n]=NULL;
+    return n;
+}
+
+/*A triangle of the scene and its distance bound, as sorted by qlscenesort*/
+typedef struct _qlsortkey{
+    double near;
+    int i;
+} qlsortkey;
+
+/*Nearest first, and in scene order between equal bounds, so the order doesn't depend on the sort*/
+static int qlsortkeycmp(const void *a,const void *b)
+{
+    const qlsortkey *x=a,*y=b;
+    if(x->near!=y->near)return x->near<y->near?-1:1;
+    return x->i-y->i;
+}
+
+qlsorted *Qlsorted(const qlscene *scene)
+{
+    qlsorted *ret;
+    if(!scene)return NULL;
+    ret=malloc(sizeof(qlsorted));
+    ret->cap=scene->len;
+    ret->len=0;
+    ret->tris=malloc(sizeof(qltri*)*(ret->cap+1));
+    ret->near=malloc(sizeof(double)*(ret->cap+1));
+    ret->keys=malloc(sizeof(qlsortkey)*(ret->cap+1));
+    ret->tris[0]=NULL;
+    return ret;
+}
+
+void freeqlsorted(qlsorted **sorted)
+{
+    if(!sorted||!(*sorted))return;
+    free((*sorted)->tris);
+    free((*sorted)->near);
+    free((*sorted)->keys);
+    free(*sorted);
+    *sorted=NULL;
+}
+
+/*
+Rays start on the image plane, at most spread away from the camera position (the farthest are at the corners,
+as the ray origins are an affine function of the pixel), so a point p is at least |p-pos|-spread away from any
+ray's origin, and every point of a triangle at least |center-pos|-radius-spread.
+*/
+int qlscenesort(const qlscene *scene,const qlcamera *camera,qlsorted *sorted)
+{
+    qlfrustum frustum;
+    int i,n=0,w,h;
+    double d,spread=0;
+    qlvect v;
+    const qlray *corner[4];
+    if(!scene||!camera||!sorted||sorted->cap<scene->len)return 0;
+    w=camera->image->w;
+    h=camera->image->h;
+    corner[0]=camera->rays[0];
+    corner[1]=camera->rays[w-1];
+    corner[2]=camera->rays[(h-1)*w];
+    corner[3]=camera->rays[h*w-1];
+    for(i=0;i<4;i++)
+    {
+        v=qlvsub(corner[i]->pos,camera->pos);
+        d=sqrt(qlvdot(v,v));
+        if(d>spread)spread=d;
+    }
+    qlcamerafrustum(camera,&frustum);
+    for(i=0;i<scene->len;i++)
+    {
+        if(!qlfrustumsphere(&frustum,&scene->centers[i],scene->radii[i]))continue;
+        v=qlvsub(scene->centers[i],camera->pos);
+        d=sqrt(qlvdot(v,v));
+        /*A small margin, as the hit distances of the triangles near the bound are subject to rounding*/
+        d=(d-scene->radii[i]-spread)-1e-9*d;
+        sorted->keys[n].near=d>0?d:0;
+        sorted->keys[n++].i=i;
+    }
+    qsort(sorted->keys,n,sizeof(qlsortkey),qlsortkeycmp);
+    for(i=0;i<n;i++)
+    {
+        sorted->tris[i]=scene->tris[sorted->keys[i].i];
+        sorted->near[i]=sorted->keys[i].near;
+    }
+    sorted->tris[n]=NULL;
+    sorted->len=n;
+    return n;
+}
+
+void qlcalcraysorted(qlray *ray,const qlsorted *sorted)
+{
+    int i,p,first=-1;
+    double s,min=INFINITY,stop;
+    qlvect dir;
+    const qltri *t;
+    if(!ray||!sorted)return;
+    p=ray->rx+ray->ry*ray->screen->w;
+    dir=qlvnormalize(ray->dir);
+    QL_STAT_INC(rays);
+    /*
+    Hits beyond stop can't change the pixel, and one at stop only does if its triangle comes first in the scene,
+    as qlcalcray keeps the first of equally distant hits
+    */
+    stop=ray->depth;
+    for(i=0;i<sorted->len;i++)
+    {
+        if(sorted->near[i]>stop)
+        {
+            QL_STAT_INC(earlyout);
+            break;
+        }
+        t=sorted->tris[i];
+        s=qlvhit(ray->pos,dir,t->a,t->b,t->c,first<0?stop:nextafter(stop,INFINITY));
+        if(s<stop||(s==stop&&sorted->keys[i].i<first))
+        {
+            min=stop=s;
+            first=sorted->keys[i].i;
+            qlputpixel(ray->screen,p,t->colour[0],t->colour[1],t->colour[2]);
+        }
+    }
+    ray->screen->z[p]=min;
+    if(min>ray->depth)qlputpixel(ray->screen,p,0,0,0);
+}
+
+static void qlcalcraysortedarg(qlray *ray,const void *sorted)
+{
+    qlcalcraysorted(ray,sorted);
+}
+
+void qltracerowssorted(qlcamera *camera,const qlsorted *sorted,int y0,int y1)
+{
+    if(!camera||!sorted)return;
+    qltracerowswith(camera,qlcalcraysortedarg,sorted,y0,y1);
+}
+
+void qlstepsorted(qlcamera *camera,const qlsorted *sorted)
+{
+    if(!camera||!sorted)return;
+    qltracerowssorted(camera,sorted,0,camera->image->h);
+    qlshade(camera);
+}
@@ -0,0 +1,104 @@
+/*
+Quicklight raycaster-like renderer - Prepared scenes
+
+Copyright (c) 2020 Amélia O. F. da S.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#ifndef QLSCENE
+#define QLSCENE
+
+#include "./quicklight.h"
+
+/*
+A scene prepared for rendering.
+Holds data derived from the triangle list that doesn't depend on the camera, so it can be shared by many views.
+*/
+typedef struct _qlscene{
+    qltri **tris;/*NULL-terminated list of triangles (not owned by the scene)*/
+    int len;/*Number of triangles*/
+    qlvect *centers;/*Centre of each triangle's bounding sphere*/
+    double *radii;/*Radius of each triangle's bounding sphere*/
+} qlscene;
+/*
+Instantiates a qlscene object from a NULL-terminated list of triangles.
+The list is referenced, not copied, and must outlive the scene.
+*/
+qlscene *Qlscene(qltri **tris);
+/*Frees a qlscene object (but not its triangles)*/
+void freeqlscene(qlscene **scene);
+/*Computes the bounding sphere qlscene keeps for a triangle*/
+void qlscenebounds(const qltri *t,qlvect *center,double *radius);
+
+/*
+The region a camera's rays can reach: the pyramid with its apex at the focal point through the corners of the image,
+cut by the image plane and by the reach of the longest ray.
+*/
+typedef struct _qlfrustum{
+    qlvect normal[5];/*Inward normals of the four side planes and of the image plane*/
+    double offset[5];/*A point p is on the inner side of plane i when normal[i].p>=offset[i]*/
+    qlvect pos;/*Camera position*/
+    double reach;/*Distance from pos beyond which no ray reaches*/
+} qlfrustum;
+/*Computes the frustum of a camera*/
+void qlcamerafrustum(const qlcamera *camera,qlfrustum *frustum);
+/*Whether a sphere may intersect a frustum*/
+char qlfrustumsphere(const qlfrustum *frustum,const qlvect *center,double radius);
+
+/*
+View frustum culling.
+Writes to out the NULL-terminated list of the scene's triangles that may be hit by the camera's rays
+(out must have room for scene->len+1 pointers) and returns how many there are.
+*/
+int qlscenecull(const qlscene *scene,const qlcamera *camera,const qltri **out);
+
+/*
+A scene's triangles in view of a camera, sorted front to back.
+Each triangle has a lower bound on its distance from the origin of any of the camera's rays,
+so a ray can stop as soon as its nearest hit is no farther than the next triangle's bound.
+*/
+typedef struct _qlsorted{
+    const qltri **tris;/*NULL-terminated list of the triangles, nearest first*/
+    double *near;/*Lower bound of the distance to each triangle, in increasing order*/
+    int len;/*Number of triangles*/
+    int cap;/*Number of triangles there is room for*/
+    struct _qlsortkey *keys;/*Scratch space for sorting (then the scene index of each triangle, to break ties between hits)*/
+} qlsorted;
+/*Instantiates a qlsorted object with room for all the triangles of a scene*/
+qlsorted *Qlsorted(const qlscene *scene);
+/*Frees a qlsorted object*/
+void freeqlsorted(qlsorted **sorted);
+/*
+Culls the scene's triangles like qlscenecull and sorts the rest front to back into sorted (which must have room for them).
+Meant to be run once per frame, after the camera moved. Returns the number of triangles in view.
+*/
+int qlscenesort(const qlscene *scene,const qlcamera *camera,qlsorted *sorted);
+/*
+Same as qlcalcray, visiting the sorted triangles until none of the rest can be closer than the nearest hit.
+Equally distant hits resolve to the triangle first in the scene, as qlcalcray does over the scene's list.
+*/
+void qlcalcraysorted(qlray *ray,const qlsorted *sorted);
+/*Same as qltracerows, for sorted triangles*/
+void qltracerowssorted(qlcamera *camera,const qlsorted *sorted,int y0,int y1);
+/*Same as qlstep, for sorted triangles*/
+void qlstepsorted(qlcamera *camera,const qlsorted *sorted);
+
+#endif
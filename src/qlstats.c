@@ -0,0 +1,150 @@
+#include "./qlstats.h"
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#ifdef QL_STATS
+#include <pthread.h>
+#endif
+/*
+Copyright (c) 2020 Amélia O. F. da S.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+static const char *_qlstagenames[QL_STAGES]={"camera","trace","shade","post","present"};
+
+qlstats _qlstatslastframe;
+qlstats _qlstatsall;
+FILE *_qlstatsdumpf=NULL;
+int _qlstatsdumpevery=0;
+char _qlstatsdumpjson=0;
+
+#ifdef QL_STATS
+/*
+Every thread gets its own block, so the hot path never touches shared memory.
+Blocks are kept in a list so qlstatsframe can find them. They are never freed, as threads may come back.
+*/
+typedef struct _qlstatsnode{
+    qlstats s;
+    struct _qlstatsnode *next;
+} qlstatsnode;
+qlstatsnode *_qlstatsnodes=NULL;
+pthread_mutex_t _qlstatslock=PTHREAD_MUTEX_INITIALIZER;
+_Thread_local qlstats *_qlstatsthread=NULL;
+
+qlstats *_qlstatsregister(void)
+{
+    qlstatsnode *node=calloc(1,sizeof(qlstatsnode));
+    if(!node)abort();
+    pthread_mutex_lock(&_qlstatslock);
+    node->next=_qlstatsnodes;
+    _qlstatsnodes=node;
+    pthread_mutex_unlock(&_qlstatslock);
+    _qlstatsthread=&node->s;
+    return _qlstatsthread;
+}
+#endif
+
+unsigned long long qlstatsnow(void)
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC,&t);
+    return (unsigned long long)t.tv_sec*1000000000ULL+t.tv_nsec;
+}
+
+/*Adds every counter of b to a*/
+static void qlstatsadd(qlstats *a,const qlstats *b)
+{
+    int i;
+    a->frames+=b->frames;
+    a->rays+=b->rays;
+    a->tritests+=b->tritests;
+    a->planemiss+=b->planemiss;
+    a->planehits+=b->planehits;
+    a->intri+=b->intri;
+    a->earlyout+=b->earlyout;
+    a->occtests+=b->occtests;
+    a->occculled+=b->occculled;
+    for(i=0;i<QL_STAGES;i++)a->ns[i]+=b->ns[i];
+}
+
+void qlstatsframe(void)
+{
+    memset(&_qlstatslastframe,0,sizeof(qlstats));
+#ifdef QL_STATS
+    qlstatsnode *node;
+    pthread_mutex_lock(&_qlstatslock);
+    for(node=_qlstatsnodes;node;node=node->next)
+    {
+        qlstatsadd(&_qlstatslastframe,&node->s);
+        memset(&node->s,0,sizeof(qlstats));
+    }
+    pthread_mutex_unlock(&_qlstatslock);
+#endif
+    _qlstatslastframe.frames=1;
+    qlstatsadd(&_qlstatsall,&_qlstatslastframe);
+    if(_qlstatsdumpf&&_qlstatsdumpevery>0&&_qlstatsall.frames%_qlstatsdumpevery==0)
+        qlstatsdump(_qlstatsdumpf,&_qlstatslastframe,_qlstatsdumpjson);
+}
+
+void qlstatslast(qlstats *out)
+{
+    if(!out)return;
+    *out=_qlstatslastframe;
+}
+
+void qlstatstotal(qlstats *out)
+{
+    if(!out)return;
+    *out=_qlstatsall;
+}
+
+void qlstatsreset(void)
+{
+    memset(&_qlstatslastframe,0,sizeof(qlstats));
+    memset(&_qlstatsall,0,sizeof(qlstats));
+}
+
+void qlstatsdump(FILE *f,const qlstats *s,char json)
+{
+    int i;
+    if(!f||!s)return;
+    if(json)
+    {
+        fprintf(f,"{\"frames\":%llu,\"rays\":%llu,\"tritests\":%llu,\"testsperray\":%.3f,\"planemiss\":%llu,\"planehits\":%llu,\"intri\":%llu,\"earlyout\":%llu,\"occtests\":%llu,\"occculled\":%llu,\"ns\":{",
+            s->frames,s->rays,s->tritests,s->rays?(double)s->tritests/s->rays:0,s->planemiss,s->planehits,s->intri,s->earlyout,s->occtests,s->occculled);
+        for(i=0;i<QL_STAGES;i++)fprintf(f,"%s\"%s\":%llu",i?",":"",_qlstagenames[i],s->ns[i]);
+        fprintf(f,"}}\n");
+    }
+    else
+    {
+        fprintf(f,"frames %llu rays %llu tritests %llu (%.2f per ray) planemiss %llu planehits %llu intri %llu earlyout %llu occtests %llu occculled %llu",
+            s->frames,s->rays,s->tritests,s->rays?(double)s->tritests/s->rays:0,s->planemiss,s->planehits,s->intri,s->earlyout,s->occtests,s->occculled);
+        for(i=0;i<QL_STAGES;i++)fprintf(f," %s %.3fms",_qlstagenames[i],s->ns[i]/1e6);
+        fprintf(f,"\n");
+    }
+    fflush(f);
+}
+
+void qlstatsautodump(FILE *f,int every,char json)
+{
+    _qlstatsdumpf=f;
+    _qlstatsdumpevery=every;
+    _qlstatsdumpjson=json;
+}
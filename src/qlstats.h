@@ -0,0 +1,100 @@
+/*
+Quicklight raycaster-like renderer - Instrumentation counters
+
+Copyright (c) 2020 Amélia O. F. da S.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef QLSTATS
+#define QLSTATS
+
+#include <stdio.h>
+
+/*
+The counters are only collected when the library is built with -DQL_STATS.
+Otherwise the QL_STAT_* macros expand to no-ops and the query functions report zeros.
+*/
+
+/*Stages timed by the instrumentation*/
+#define QL_STAGE_CAMERA 0 /*qlupdatecamera*/
+#define QL_STAGE_TRACE 1 /*Tracing the rays in qlstep*/
+#define QL_STAGE_SHADE 2 /*qlshade*/
+#define QL_STAGE_POST 3 /*qlpostrun*/
+#define QL_STAGE_PRESENT 4 /*Drawing to the X11 window*/
+#define QL_STAGES 5
+
+/*
+A set of counters.
+Each thread increments its own copy, and they are summed up once per frame by qlstatsframe.
+*/
+typedef struct _qlstats{
+    unsigned long long frames;/*Number of frames aggregated in this set*/
+    unsigned long long rays;/*Rays traced*/
+    unsigned long long tritests;/*Ray-triangle tests*/
+    unsigned long long planemiss;/*Tests rejected at the plane intersection (parallel plane, behind the ray, or farther than the current hit)*/
+    unsigned long long planehits;/*Tests that reached the in-triangle test*/
+    unsigned long long intri;/*In-triangle tests that passed*/
+    unsigned long long earlyout;/*Rays that stopped before the end of a front-to-back sorted list (see qlscenesort)*/
+    unsigned long long occtests;/*Triangles tested by occlusion culling*/
+    unsigned long long occculled;/*Triangles removed by occlusion culling*/
+    unsigned long long ns[QL_STAGES];/*Nanoseconds spent on each stage*/
+} qlstats;
+
+#ifdef QL_STATS
+/*Counters of the calling thread. Use the macros below instead of touching it directly.*/
+extern _Thread_local qlstats *_qlstatsthread;
+/*Allocates and registers the calling thread's counters*/
+qlstats *_qlstatsregister(void);
+#define QL_STAT_ADD(field,n) ((_qlstatsthread?_qlstatsthread:_qlstatsregister())->field+=(n))
+#define QL_STAT_TIMER(t) unsigned long long t=qlstatsnow()
+#define QL_STAT_TIME(stage,t) QL_STAT_ADD(ns[stage],qlstatsnow()-(t))
+#else
+/*Expression no-ops rather than nothing, so that "else QL_STAT_INC(...);" doesn't leave an empty body*/
+#define QL_STAT_ADD(field,n) ((void)0)
+#define QL_STAT_TIMER(t)
+#define QL_STAT_TIME(stage,t) ((void)0)
+#endif
+#define QL_STAT_INC(field) QL_STAT_ADD(field,1)
+
+/*Monotonic clock, in nanoseconds*/
+unsigned long long qlstatsnow(void);
+
+/*
+Closes the current frame: sums every thread's counters into the frame statistics and zeroes them.
+Must not be called while other threads are still tracing.
+qlrender calls it after presenting; applications calling qlstep directly should call it after each frame.
+*/
+void qlstatsframe(void);
+/*Copies the statistics of the last closed frame to out*/
+void qlstatslast(qlstats *out);
+/*Copies the statistics accumulated over all closed frames to out*/
+void qlstatstotal(qlstats *out);
+/*Clears the accumulated statistics*/
+void qlstatsreset(void);
+
+/*Writes a set of statistics to f as a line of text (json=0) or as a JSON object (json=1)*/
+void qlstatsdump(FILE *f,const qlstats *s,char json);
+/*
+Makes qlstatsframe dump the last frame's statistics to f every <every> frames.
+every=0 (or f=NULL) disables the dump.
+*/
+void qlstatsautodump(FILE *f,int every,char json);
+
+#endif
@@ -0,0 +1,393 @@
+#include "./qlstream.h"
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <netdb.h>
+#include <poll.h>
+/*
+Copyright (c) 2020 Amélia O. F. da S.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#define QL_STREAM_HEADER 20
+#define QL_STREAM_TILEHEADER 12
+/*Largest encoded tile: every pixel a literal, plus one header byte for each 128 of them*/
+#define QL_STREAM_MAXTILE (QL_STREAM_TILE*QL_STREAM_TILE*3+(QL_STREAM_TILE*QL_STREAM_TILE+127)/128)
+
+static void qlput32(unsigned char *p,unsigned int v)
+{
+    p[0]=v;
+    p[1]=v>>8;
+    p[2]=v>>16;
+    p[3]=v>>24;
+}
+
+static unsigned int qlget32(const unsigned char *p)
+{
+    return p[0]|(p[1]<<8)|(p[2]<<16)|((unsigned int)p[3]<<24);
+}
+
+int qlsendall(int fd,const unsigned char *p,size_t len)
+{
+    ssize_t n;
+    while(len)
+    {
+        n=send(fd,p,len,MSG_NOSIGNAL);
+        if(n<0&&errno==EINTR)continue;
+        if(n<=0)return -1;
+        p+=n;
+        len-=n;
+    }
+    return 0;
+}
+int qlrecvall(int fd,unsigned char *p,size_t len)
+{
+    ssize_t n;
+    while(len)
+    {
+        n=recv(fd,p,len,0);
+        if(n<0&&errno==EINTR)continue;
+        if(n<=0)return -1;
+        p+=n;
+        len-=n;
+    }
+    return 0;
+}
+
+int qlstreamsocket(const char *addr,char server)
+{
+    int fd,one=1;
+    if(!addr)return -1;
+    if(!strncmp(addr,"unix:",5))
+    {
+        struct sockaddr_un un;
+        if(strlen(addr+5)>=sizeof(un.sun_path))return -1;
+        memset(&un,0,sizeof(un));
+        un.sun_family=AF_UNIX;
+        strcpy(un.sun_path,addr+5);
+        fd=socket(AF_UNIX,SOCK_STREAM,0);
+        if(fd<0)return -1;
+        if(server)
+        {
+            unlink(un.sun_path);
+            if(bind(fd,(struct sockaddr*)&un,sizeof(un))||listen(fd,QL_STREAM_CLIENTS)){close(fd);return -1;}
+        }
+        else if(connect(fd,(struct sockaddr*)&un,sizeof(un))){close(fd);return -1;}
+        return fd;
+    }
+    if(!strncmp(addr,"tcp:",4))
+    {
+        struct addrinfo hints,*res,*r;
+        char host[256];
+        const char *port=strrchr(addr,':')+1;
+        memset(&hints,0,sizeof(hints));
+        hints.ai_family=AF_UNSPEC;
+        hints.ai_socktype=SOCK_STREAM;
+        if(server)hints.ai_flags=AI_PASSIVE;
+        if(port-addr-5>0)
+        {
+            if(port-addr-5>=(long)sizeof(host))return -1;
+            memcpy(host,addr+4,port-addr-5);
+            host[port-addr-5]=0;
+        }
+        if(getaddrinfo(port-addr-5>0?host:NULL,port,&hints,&res))return -1;
+        fd=-1;
+        for(r=res;r;r=r->ai_next)
+        {
+            fd=socket(r->ai_family,r->ai_socktype,r->ai_protocol);
+            if(fd<0)continue;
+            if(server)
+            {
+                setsockopt(fd,SOL_SOCKET,SO_REUSEADDR,&one,sizeof(one));
+                if(!bind(fd,r->ai_addr,r->ai_addrlen)&&!listen(fd,QL_STREAM_CLIENTS))break;
+            }
+            else if(!connect(fd,r->ai_addr,r->ai_addrlen))
+            {
+                setsockopt(fd,IPPROTO_TCP,TCP_NODELAY,&one,sizeof(one));
+                break;
+            }
+            close(fd);
+            fd=-1;
+        }
+        freeaddrinfo(res);
+        return fd;
+    }
+    return -1;
+}
+
+qlstream *Qlstream(const char *addr)
+{
+    qlstream *ret;
+    int i,fd=qlstreamsocket(addr,1);
+    if(fd<0)return NULL;
+    ret=malloc(sizeof(qlstream));
+    ret->fd=fd;
+    for(i=0;i<QL_STREAM_CLIENTS;i++)ret->clients[i]=-1;
+    ret->key=1;
+    ret->w=ret->h=0;
+    ret->prev=NULL;
+    ret->buf=NULL;
+    ret->framebytes=ret->bytes=0;
+    return ret;
+}
+
+int qlstreamaccept(qlstream *stream,char block)
+{
+    struct pollfd p;
+    int i,fd,n=0;
+    if(!stream)return -1;
+    p.fd=stream->fd;
+    p.events=POLLIN;
+    while(poll(&p,1,block&&!n?-1:0)>0)
+    {
+        fd=accept(stream->fd,NULL,NULL);
+        if(fd<0)return n?n:-1;
+        for(i=0;i<QL_STREAM_CLIENTS&&stream->clients[i]>=0;i++){}
+        if(i==QL_STREAM_CLIENTS){close(fd);continue;}
+        stream->clients[i]=fd;
+        /*New clients have no previous frame to apply deltas to*/
+        stream->key=1;
+        n++;
+    }
+    return n;
+}
+
+/*
+PackBits over 3-byte pixels: a header byte h<128 is followed by h+1 literal pixels,
+and h>=128 by one pixel repeated h-126 times.
+*/
+static int qlpackbits(const unsigned char *p,int n,unsigned char *out)
+{
+    int i=0,run,start;
+    unsigned char *o=out;
+    while(i<n)
+    {
+        for(run=1;i+run<n&&run<129&&!memcmp(p+(i+run)*3,p+i*3,3);run++){}
+        if(run>1)
+        {
+            *o++=run+126;
+            memcpy(o,p+i*3,3);
+            o+=3;
+            i+=run;
+            continue;
+        }
+        start=i++;
+        while(i<n&&i-start<128&&!(i+1<n&&!memcmp(p+i*3,p+(i+1)*3,3)))i++;
+        *o++=i-start-1;
+        memcpy(o,p+start*3,(i-start)*3);
+        o+=(i-start)*3;
+    }
+    return o-out;
+}
+
+long qlstreamframe(qlstream *stream,const qlraster *image)
+{
+    unsigned char tile[QL_STREAM_TILE*QL_STREAM_TILE*3],rgb[3],*o,*prev;
+    int tx,ty,x,y,tw,th,i,n,ntiles=0,changed,clients=0;
+    long len;
+    if(!stream||!image)return -1;
+    qlstreamaccept(stream,0);
+    if(image->w!=stream->w||image->h!=stream->h)
+    {
+        stream->w=image->w;
+        stream->h=image->h;
+        free(stream->prev);
+        free(stream->buf);
+        stream->prev=calloc(image->w*image->h,3);
+        n=((image->w+QL_STREAM_TILE-1)/QL_STREAM_TILE)*((image->h+QL_STREAM_TILE-1)/QL_STREAM_TILE);
+        stream->buf=malloc(QL_STREAM_HEADER+n*(QL_STREAM_TILEHEADER+QL_STREAM_MAXTILE));
+        stream->key=1;
+    }
+    if(stream->key)memset(stream->prev,0,image->w*image->h*3);
+    o=stream->buf+QL_STREAM_HEADER;
+    for(ty=0;ty*QL_STREAM_TILE<image->h;ty++)
+    for(tx=0;tx*QL_STREAM_TILE<image->w;tx++)
+    {
+        tw=image->w-tx*QL_STREAM_TILE<QL_STREAM_TILE?image->w-tx*QL_STREAM_TILE:QL_STREAM_TILE;
+        th=image->h-ty*QL_STREAM_TILE<QL_STREAM_TILE?image->h-ty*QL_STREAM_TILE:QL_STREAM_TILE;
+        changed=stream->key;
+        n=0;
+        for(y=ty*QL_STREAM_TILE;y<ty*QL_STREAM_TILE+th;y++)
+        for(x=tx*QL_STREAM_TILE;x<tx*QL_STREAM_TILE+tw;x++,n++)
+        {
+            prev=stream->prev+(x+y*image->w)*3;
+            qlgetpixel(image,x+y*image->w,rgb);
+            for(i=0;i<3;i++)
+            {
+                tile[n*3+i]=prev[i]^rgb[i];
+                changed|=tile[n*3+i];
+                prev[i]=rgb[i];
+            }
+        }
+        if(!changed)continue;
+        qlput32(o,tx);
+        qlput32(o+4,ty);
+        len=qlpackbits(tile,n,o+QL_STREAM_TILEHEADER);
+        qlput32(o+8,len);
+        o+=QL_STREAM_TILEHEADER+len;
+        ntiles++;
+    }
+    memcpy(stream->buf,"QLFB",4);
+    qlput32(stream->buf+4,image->w);
+    qlput32(stream->buf+8,image->h);
+    qlput32(stream->buf+12,stream->key?QL_STREAM_KEY:0);
+    qlput32(stream->buf+16,ntiles);
+    len=o-stream->buf;
+    for(i=0;i<QL_STREAM_CLIENTS;i++)
+    {
+        if(stream->clients[i]<0)continue;
+        if(qlsendall(stream->clients[i],stream->buf,len))
+        {
+            close(stream->clients[i]);
+            stream->clients[i]=-1;
+        }
+        else clients++;
+    }
+    /*Without clients there's nobody to keep in sync, so whoever comes next needs a key frame anyway*/
+    stream->key=clients==0;
+    stream->framebytes=len;
+    stream->bytes+=len;
+    return len;
+}
+
+void freeqlstream(qlstream **stream)
+{
+    int i;
+    if(!stream||!(*stream))return;
+    for(i=0;i<QL_STREAM_CLIENTS;i++)if((*stream)->clients[i]>=0)close((*stream)->clients[i]);
+    close((*stream)->fd);
+    free((*stream)->prev);
+    free((*stream)->buf);
+    free(*stream);
+    *stream=NULL;
+}
+
+qlstreamclient *Qlstreamclient(const char *addr)
+{
+    qlstreamclient *ret;
+    int fd=qlstreamsocket(addr,0);
+    if(fd<0)return NULL;
+    ret=malloc(sizeof(qlstreamclient));
+    ret->fd=fd;
+    ret->image=NULL;
+    ret->prev=NULL;
+    ret->fmt=QL_RGB24;
+    ret->s=3;
+    ret->buf=malloc(QL_STREAM_MAXTILE);
+    return ret;
+}
+
+int qlstreamrecv(qlstreamclient *client)
+{
+    unsigned char header[QL_STREAM_HEADER],*p,*end,*prev;
+    unsigned int w,h,flags,ntiles,tx,ty,len,t;
+    int x,y,i,n,count,lit,fmt;
+    char repaint;
+    if(!client)return -1;
+    if(qlrecvall(client->fd,header,QL_STREAM_HEADER)||memcmp(header,"QLFB",4))return -1;
+    w=qlget32(header+4);
+    h=qlget32(header+8);
+    flags=qlget32(header+12);
+    ntiles=qlget32(header+16);
+    if(!w||!h||w>65535||h>65535||(size_t)w*h>QL_STREAM_MAXPIXELS)return -1;
+    if(!client->image||client->image->w!=(int)w||client->image->h!=(int)h)
+    {
+        /*The new image keeps the format the old one was switched to*/
+        fmt=client->image?client->image->fmt:QL_RGB24;
+        freeqlraster(&client->image);
+        free(client->prev);
+        client->image=Qlraster(w,h,3);
+        client->prev=malloc((size_t)w*h*3);
+        if(!client->image||!client->image->data||!client->prev)
+        {
+            freeqlraster(&client->image);
+            free(client->prev);
+            client->prev=NULL;
+            return -1;
+        }
+        qlrastersetformat(client->image,fmt);
+        flags|=QL_STREAM_KEY;
+    }
+    /*If the image's format changed since the last frame (qlrastersetformat reallocates its pixels), it's redrawn from prev*/
+    repaint=client->image->fmt!=client->fmt||client->image->s!=client->s;
+    if(flags&QL_STREAM_KEY)
+    {
+        memset(client->prev,0,(size_t)w*h*3);
+        memset(client->image->data,0,(size_t)w*h*client->image->s);
+    }
+    for(t=0;t<ntiles;t++)
+    {
+        if(qlrecvall(client->fd,header,QL_STREAM_TILEHEADER))return -1;
+        tx=qlget32(header);
+        ty=qlget32(header+4);
+        len=qlget32(header+8);
+        if(len>QL_STREAM_MAXTILE||tx*QL_STREAM_TILE>=w||ty*QL_STREAM_TILE>=h)return -1;
+        if(qlrecvall(client->fd,client->buf,len))return -1;
+        /*Walk the tile's pixels while unpacking, XORing each one into the previous frame and writing it to the image*/
+        p=client->buf;
+        end=p+len;
+        x=tx*QL_STREAM_TILE;
+        y=ty*QL_STREAM_TILE;
+        n=0;
+        while(p<end)
+        {
+            lit=*p<128;
+            count=lit?*p+1:*p-126;
+            p++;
+            while(count--)
+            {
+                if(p+3>end||y>=(int)h)return -1;
+                prev=client->prev+(x+y*w)*3;
+                for(i=0;i<3;i++)prev[i]^=p[i];
+                qlputpixel(client->image,x+y*w,prev[0],prev[1],prev[2]);
+                if(lit)p+=3;
+                n++;
+                if(++x==(int)(tx*QL_STREAM_TILE+QL_STREAM_TILE)||x==(int)w)
+                {
+                    x=tx*QL_STREAM_TILE;
+                    y++;
+                }
+            }
+            if(!lit)p+=3;
+        }
+    }
+    if(repaint)
+        for(i=0;i<(int)(w*h);i++)qlputpixel(client->image,i,client->prev[i*3],client->prev[i*3+1],client->prev[i*3+2]);
+    client->fmt=client->image->fmt;
+    client->s=client->image->s;
+    return ntiles;
+}
+
+void freeqlstreamclient(qlstreamclient **client)
+{
+    if(!client||!(*client))return;
+    close((*client)->fd);
+    freeqlraster(&(*client)->image);
+    free((*client)->prev);
+    free((*client)->buf);
+    free(*client);
+    *client=NULL;
+}
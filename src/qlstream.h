@@ -0,0 +1,116 @@
+/*
+Quicklight raycaster-like renderer - Framebuffer streaming
+
+Copyright (c) 2020 Amélia O. F. da S.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#ifndef QLSTREAM
+#define QLSTREAM
+
+#include <stddef.h>
+#include "./quicklight.h"
+
+/*
+Frames are streamed as tiles of QL_STREAM_TILE x QL_STREAM_TILE pixels. Only the tiles that changed since
+the previous frame are sent, XORed with their previous contents and run-length encoded (PackBits over RGB pixels).
+
+Wire format (every integer is a little-endian uint32):
+    frame: "QLFB" w h flags ntiles, followed by ntiles tiles
+    tile:  x y length, followed by <length> bytes of encoded pixels (x and y in tiles)
+If flags has QL_STREAM_KEY set the tiles are XORed with black instead of the previous frame (sent to new clients).
+*/
+#define QL_STREAM_TILE 16
+#define QL_STREAM_KEY 1
+/*Largest frame (in pixels) a client accepts, so the buffers' sizes can't overflow*/
+#define QL_STREAM_MAXPIXELS (1<<26)
+/*Maximum number of clients watching a stream*/
+#define QL_STREAM_CLIENTS 16
+
+/*
+A framebuffer stream server.
+Rasters in any pixel format can be streamed. They are always sent (and received) as RGB.
+*/
+typedef struct _qlstream{
+    int fd;/*Listening socket*/
+    int clients[QL_STREAM_CLIENTS];/*Sockets of the connected clients (-1 for free slots)*/
+    char key;/*Whether the next frame must be a key frame*/
+    int w;/*Width of the frames being streamed*/
+    int h;/*Height of the frames being streamed*/
+    unsigned char *prev;/*Previous frame sent, as RGB*/
+    unsigned char *buf;/*Encoding buffer*/
+    unsigned long long framebytes;/*Bytes sent (to each client) for the last frame*/
+    unsigned long long bytes;/*Bytes sent (to each client) since the stream was opened*/
+} qlstream;
+/*
+Opens a stream server at addr, which is either "unix:<path>" or "tcp:<port>" (listening on every interface).
+Returns NULL on errors. One should close it with freeqlstream.
+*/
+qlstream *Qlstream(const char *addr);
+/*
+Accepts clients waiting to connect. If block is set, waits until at least one client connects.
+Returns the number of clients accepted, or -1 on errors.
+*/
+int qlstreamaccept(qlstream *stream,char block);
+/*
+Sends a frame to every connected client (accepting new ones first).
+Clients that disconnected are dropped. Returns the number of bytes sent to each client, or -1 on errors.
+*/
+long qlstreamframe(qlstream *stream,const qlraster *image);
+/*Closes a stream server and all its clients' connections*/
+void freeqlstream(qlstream **stream);
+
+/*
+A framebuffer stream client.
+*/
+typedef struct _qlstreamclient{
+    int fd;/*Socket connected to the server*/
+    qlraster *image;/*Last frame received (allocated when the first frame arrives, and reallocated when the frame size changes). Its pixel format may be changed between frames.*/
+    unsigned char *prev;/*Last frame received, as RGB (deltas are applied to it, so they survive changes of the image's format)*/
+    int fmt;/*Pixel format of the image when the last frame was written to it*/
+    int s;/*Pixel size of the image when the last frame was written to it*/
+    unsigned char *buf;/*Decoding buffer*/
+} qlstreamclient;
+/*
+Connects to a stream server at addr (as in Qlstream, but "tcp:<host>:<port>").
+Returns NULL on errors. One should close it with freeqlstreamclient.
+*/
+qlstreamclient *Qlstreamclient(const char *addr);
+/*
+Waits for the next frame and applies it to client->image.
+Returns the number of tiles that changed, or -1 if the connection was closed or the data is invalid.
+*/
+int qlstreamrecv(qlstreamclient *client);
+/*Closes a stream client*/
+void freeqlstreamclient(qlstreamclient **client);
+
+/*Socket helpers, shared with the other modules that talk over sockets*/
+
+/*
+Opens a socket for addr ("unix:<path>", "tcp:<port>" or "tcp:<host>:<port>").
+Servers bind and listen on it, clients connect to it. Returns the socket, or -1 on errors.
+*/
+int qlstreamsocket(const char *addr,char server);
+/*Sends or receives exactly len bytes. Returns 0 on success and -1 if the connection failed.*/
+int qlsendall(int fd,const unsigned char *p,size_t len);
+int qlrecvall(int fd,unsigned char *p,size_t len);
+
+#endif
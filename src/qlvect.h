@@ -0,0 +1,134 @@
+/*
+Quicklight raycaster-like renderer - Inline vector maths
+
+Copyright (c) 2020 Amélia O. F. da S.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+#ifndef QLVECT
+#define QLVECT
+
+#include <math.h>
+#include "./quicklight.h"
+#include "./qlstats.h"
+
+/*
+Value-semantics versions of the vector functions in quicklight.h.
+They take and return qlvects by value and don't check for NULL pointers, so the compiler can inline them
+and keep the coordinates in registers. The pointer functions in quicklight.h are wrappers around these.
+*/
+
+/*Builds a vector from its coordinates*/
+static inline qlvect qlv(double x,double y,double z)
+{
+    qlvect ret={x,y,z};
+    return ret;
+}
+/*A+B*/
+static inline qlvect qlvsum(qlvect a,qlvect b)
+{
+    return qlv(a.x+b.x,a.y+b.y,a.z+b.z);
+}
+/*A-B*/
+static inline qlvect qlvsub(qlvect a,qlvect b)
+{
+    return qlv(a.x-b.x,a.y-b.y,a.z-b.z);
+}
+/*s*A*/
+static inline qlvect qlvscale(qlvect a,double s)
+{
+    return qlv(a.x*s,a.y*s,a.z*s);
+}
+/*Scalar product*/
+static inline double qlvdot(qlvect a,qlvect b)
+{
+    return a.x*b.x+a.y*b.y+a.z*b.z;
+}
+/*Vectorial product (see qlvectproduct)*/
+static inline qlvect qlvcross(qlvect a,qlvect b)
+{
+    return qlv(a.y*b.z-a.z*b.y,a.z*b.x-a.x*b.z,a.x*b.y-a.y*b.x);
+}
+/*A scaled to length 1*/
+static inline qlvect qlvnormalize(qlvect a)
+{
+    double sf=sqrt(qlvdot(a,a));
+    return qlv(a.x/sf,a.y/sf,a.z/sf);
+}
+/*A rotated around the x,y and z axes by rx,ry and rz radians (see qlvectrotate)*/
+static inline qlvect qlvrotate(qlvect a,double rx,double ry,double rz)
+{
+    double srx=sin(rx),sry=sin(ry),srz=sin(rz),crx=cos(rx),cry=cos(ry),crz=cos(rz);
+    return qlv((a.x*(crz*cry))+(a.y*(crz*sry*srx-srz*crx))+(a.z*(crz*sry*crx+srz*srx)),
+        (a.x*(srz*cry))+(a.y*(srz*sry*srx+crz*crx))+(a.z*(srz*sry*crx-crz*srx)),
+        (a.x*(-sry))+(a.y*(cry*srx))+(a.z*(cry*crx)));
+}
+/*A rotated around the r axis by rv radians (see qlvectrotateaxis)*/
+static inline qlvect qlvrotateaxis(qlvect a,qlvect r,double rv)
+{
+    double c=cos(rv);
+    qlvect ret=qlvsum(qlvscale(a,c),qlvscale(qlvcross(r,a),sin(rv)));
+    return qlvsum(ret,qlvscale(r,qlvdot(r,a)*(1-c)));
+}
+
+/*Vector-Triangle functions*/
+
+/*qlvectintersect for a triangle given by its vertices (INFINITY when the vector is parallel to the plane)*/
+static inline double qlvintersect(qlvect pos,qlvect dir,qlvect a,qlvect b,qlvect c)
+{
+    qlvect normal=qlvcross(qlvsub(a,b),qlvsub(a,c));
+    double s=qlvdot(dir,normal);
+    double t=qlvdot(qlvsub(a,pos),normal);
+    return s==0?INFINITY:t/s;
+}
+/*
+qlvectintri for point p and a triangle given by its vertices.
+All three edges are always tested, so the result doesn't need any branches.
+*/
+static inline char qlvintri(qlvect p,qlvect a,qlvect b,qlvect c)
+{
+    qlvect ab=qlvsub(a,b);
+    qlvect normal=qlvcross(qlvsub(a,c),ab);
+    double reference=qlvdot(qlvcross(qlvsub(p,a),ab),normal);
+    double bc=qlvdot(qlvcross(qlvsub(p,b),qlvsub(b,c)),normal);
+    double ca=qlvdot(qlvcross(qlvsub(p,c),qlvsub(c,a)),normal);
+    return !(bc*reference<0)&!(ca*reference<0);
+}
+/*
+Distance from pos along the normalized dir to the triangle abc if the ray hits it closer than stop, otherwise INFINITY.
+This is the test every ray caster runs on each triangle, and it counts it in the tracing statistics.
+*/
+static inline double qlvhit(qlvect pos,qlvect dir,qlvect a,qlvect b,qlvect c,double stop)
+{
+    double s=qlvintersect(pos,dir,a,b,c);
+    QL_STAT_INC(tritests);
+    if(!(s>=0&&s<stop))
+    {
+        QL_STAT_INC(planemiss);
+        return INFINITY;
+    }
+    QL_STAT_INC(planehits);
+    if(!qlvintri(qlvsum(pos,qlvscale(dir,s)),a,b,c))return INFINITY;
+    QL_STAT_INC(intri);
+    return s;
+}
+
+#endif
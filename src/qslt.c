@@ -2,6 +2,8 @@
 #include "quicklight.h"
 #include <stdio.h>
 #include <stdlib.h>
+#include <ctype.h>
+#include "qlstats.h"
 /*
 Copyright (c) 2020 Amélia O. F. da S.
 
@@ -23,50 +25,62 @@ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
 OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
 SOFTWARE.
 */
+/*Skips blank space and comment lines*/
+static void qltskip(FILE *f)
+{
+    int c;
+    while((c=fgetc(f))!=EOF)
+    {
+        if(c=='#')while((c=fgetc(f))!=EOF&&c!='\n'){}
+        else if(!isspace(c))
+        {
+            ungetc(c,f);
+            return;
+        }
+    }
+}
+
+/*Reads the number of triangles announced by the file (or -1)*/
+static int qltcount(FILE *f)
+{
+    int len;
+    qltskip(f);
+    if(fscanf(f,"%d",&len)!=1||len<0)return -1;
+    fscanf(f,"%*[^\n]");
+    return len;
+}
+
+/*Reads the next triangle (or returns NULL at the end of the file)*/
+static qltri *qltnext(FILE *f)
+{
+    int r,g,b;
+    qlvect aa,bb,cc;
+    qltri *ret;
+    qltskip(f);
+    if(fscanf(f,"%d %d %d %lf %lf %lf %lf %lf %lf %lf %lf %lf",&r,&g,&b,
+        &aa.x,&aa.y,&aa.z,&bb.x,&bb.y,&bb.z,&cc.x,&cc.y,&cc.z)!=12)return NULL;
+    ret=Qltri(&aa,&bb,&cc);
+    ret->colour[0]=(char)r;
+    ret->colour[1]=(char)g;
+    ret->colour[2]=(char)b;
+    return ret;
+}
+
 qltri** qltToQltriList(const char* fname)
 {
-    qltri **ret=NULL;
-    qlvect *aa=Qlvect(0,0,0),*bb=Qlvect(0,0,0),*cc=Qlvect(0,0,0);
+    qltri **ret;
+    int i,len;
     FILE* f=fopen(fname,"r");
     if(!f)return NULL;
-    char r,g,b;
-    int i=0,len,_r,_g,_b;
-    while(!feof(f))
+    len=qltcount(f);
+    if(len<0)
     {
-        if(fgetc(f)=='#'){fscanf(f,"%*[^\n]");fscanf(f,"%*[\n\r]");}
-        else{
-            fseek(f,-1,SEEK_CUR);
-            if(ret)
-            {
-                fscanf(f,"%d",&_r);
-                r=(char)_r;
-                fscanf(f,"%d",&_g);
-                g=(char)_g;
-                fscanf(f,"%d",&_b);
-                b=(char)_b;
-                fscanf(f,"%lf",&aa->x);
-                fscanf(f,"%lf",&aa->y);
-                fscanf(f,"%lf",&aa->z);
-                fscanf(f,"%lf",&bb->x);
-                fscanf(f,"%lf",&bb->y);
-                fscanf(f,"%lf",&bb->z);
-                fscanf(f,"%lf",&cc->x);
-                fscanf(f,"%lf",&cc->y);
-                fscanf(f,"%lf",&cc->z);
-                ret[i]=Qltri(aa,bb,cc);
-                ret[i]->colour[0]=r;
-                ret[i]->colour[1]=g;
-                ret[i++]->colour[2]=b;
-                fscanf(f,"%*[\n\r]");
-            }
-            else{
-                fscanf(f,"%d",&len);
-                ret=malloc(sizeof(qltri*)*len+1);
-                ret[len]=NULL;
-                fscanf(f,"%*[^\n]");fscanf(f,"%*[\n\r]");
-            }
-        }
+        fclose(f);
+        return NULL;
     }
+    ret=calloc(len+1,sizeof(qltri*));
+    for(i=0;i<len;i++)
+        if(!(ret[i]=qltnext(f)))break;
     fclose(f);
     return ret;
 }
@@ -86,4 +100,124 @@ int qllen(void** array)
     int i=0;
     while(array[i++]!=NULL){}
     return i-1;
-}
\ No newline at end of file
+}
+static void *qltloadthread(void *arg)
+{
+    qltload *load=arg;
+    qltri *t;
+    int stop=0;
+    while(!stop&&load->parsed<load->total&&(t=qltnext(load->f)))
+    {
+        /*The bounding spheres are computed here, so the renderer doesn't have to*/
+        qlscenebounds(t,&load->scene.centers[load->parsed],&load->scene.radii[load->parsed]);
+        load->tris[load->parsed++]=t;
+        if(load->parsed%load->batch==0)
+        {
+            pthread_mutex_lock(&load->lock);
+            load->published=load->parsed;
+            if(!load->firstbatch)load->firstbatch=qlstatsnow()-load->start;
+            stop=load->quit;
+            pthread_mutex_unlock(&load->lock);
+            if(load->onpublish)load->onpublish(load->arg);
+        }
+    }
+    fclose(load->f);
+    load->f=NULL;
+    pthread_mutex_lock(&load->lock);
+    load->published=load->parsed;
+    if(!load->firstbatch&&load->parsed)load->firstbatch=qlstatsnow()-load->start;
+    load->loaded=qlstatsnow()-load->start;
+    load->done=1;
+    pthread_mutex_unlock(&load->lock);
+    if(load->onpublish)load->onpublish(load->arg);
+    return NULL;
+}
+
+qltload *Qltload(const char *fname,int batch,void (*onpublish)(void *arg),void *arg)
+{
+    qltload *ret;
+    FILE *f;
+    int len;
+    if(!fname)return NULL;
+    f=fopen(fname,"r");
+    if(!f)return NULL;
+    len=qltcount(f);
+    if(len<0)
+    {
+        fclose(f);
+        return NULL;
+    }
+    ret=malloc(sizeof(qltload));
+    ret->start=qlstatsnow();
+    ret->f=f;
+    ret->total=len;
+    ret->batch=batch>0?batch:1;
+    ret->tris=malloc(sizeof(qltri*)*(len+1));
+    ret->parsed=ret->published=0;
+    ret->done=ret->quit=0;
+    ret->onpublish=onpublish;
+    ret->arg=arg;
+    /*The renderer's list is NULL-terminated at any length*/
+    ret->scene.tris=calloc(len+1,sizeof(qltri*));
+    ret->scene.len=0;
+    ret->scene.centers=malloc(sizeof(qlvect)*(len+1));
+    ret->scene.radii=malloc(sizeof(double)*(len+1));
+    ret->complete=0;
+    ret->firstbatch=ret->loaded=ret->firstframe=ret->fullframe=0;
+    ret->joined=0;
+    pthread_mutex_init(&ret->lock,NULL);
+    if(pthread_create(&ret->thread,NULL,qltloadthread,ret))
+    {
+        /*Without a thread, load the file right away*/
+        qltloadthread(ret);
+        ret->joined=1;
+    }
+    return ret;
+}
+
+int qltloadpoll(qltload *load)
+{
+    int published,i;
+    char done;
+    if(!load)return 0;
+    pthread_mutex_lock(&load->lock);
+    published=load->published;
+    done=load->done;
+    pthread_mutex_unlock(&load->lock);
+    for(i=load->scene.len;i<published;i++)load->scene.tris[i]=load->tris[i];
+    load->scene.len=published;
+    load->complete=done;
+    return published;
+}
+
+void qltloadframe(qltload *load)
+{
+    if(!load||!load->scene.len)return;
+    if(!load->firstframe)load->firstframe=qlstatsnow()-load->start;
+    if(load->complete&&!load->fullframe)load->fullframe=qlstatsnow()-load->start;
+}
+
+void qltloadwait(qltload *load)
+{
+    if(!load||load->joined)return;
+    pthread_join(load->thread,NULL);
+    load->joined=1;
+}
+
+void freeqltload(qltload **load)
+{
+    int i;
+    if(!load||!(*load))return;
+    pthread_mutex_lock(&(*load)->lock);
+    (*load)->quit=1;
+    pthread_mutex_unlock(&(*load)->lock);
+    qltloadwait(*load);
+    for(i=0;i<(*load)->parsed;i++)free((*load)->tris[i]);
+    free((*load)->tris);
+    free((*load)->scene.tris);
+    free((*load)->scene.centers);
+    free((*load)->scene.radii);
+    pthread_mutex_destroy(&(*load)->lock);
+    free(*load);
+    *load=NULL;
+}
@@ -1,4 +1,7 @@
 #include "./quicklight.h"
+#include "./qlscene.h"
+#include <stdio.h>
+#include <pthread.h>
 
 /*
 slt (slowLight Triangles) file reader for quicklight.
@@ -40,4 +43,51 @@ Returns the length of a NULL-sentinel list
 */
 int qllen(void** array);
 
+/*
+A qlt file being loaded in the background.
+A loader thread parses the triangles and their bounding spheres (the data qlscene keeps), handing them over to the
+renderer in batches, so frames can be drawn while the rest of the file is still being read.
+Fields marked (loader) belong to the loader thread, and the ones marked (lock) are shared with it.
+*/
+typedef struct _qltload{
+    FILE *f;/*The file being read (loader)*/
+    int total;/*Number of triangles announced by the file*/
+    int batch;/*Triangles handed over at a time*/
+    qltri **tris;/*Triangles parsed so far (loader, up to published)*/
+    int parsed;/*Number of triangles parsed (loader)*/
+    int published;/*Number of triangles handed over (lock)*/
+    char done;/*Whether the loader thread is finished (lock)*/
+    char quit;/*Asks the loader thread to stop (lock)*/
+    void (*onpublish)(void *arg);/*Called by the loader thread after each batch (or NULL)*/
+    void *arg;/*Argument passed to onpublish*/
+    qlscene scene;/*The triangles the renderer has taken so far, as a scene (updated by qltloadpoll)*/
+    char complete;/*Whether scene holds the whole file (updated by qltloadpoll)*/
+    unsigned long long start;/*When loading started (see qlstatsnow)*/
+    unsigned long long firstbatch;/*Nanoseconds until the first batch was handed over (lock)*/
+    unsigned long long loaded;/*Nanoseconds until the whole file was read (lock)*/
+    unsigned long long firstframe;/*Nanoseconds until the first frame with triangles was drawn (see qltloadframe)*/
+    unsigned long long fullframe;/*Nanoseconds until the first frame with the whole scene was drawn*/
+    pthread_t thread;/*Loader thread*/
+    char joined;/*Whether the loader thread was joined*/
+    pthread_mutex_t lock;
+} qltload;
+/*
+Starts loading a qlt file in the background, handing triangles over <batch> at a time.
+onpublish(arg) is called from the loader thread after each batch (and when loading ends), and may be NULL;
+qlscreendirty makes a good one. Returns NULL if the file can't be opened.
+One should free it with freeqltload, which also frees the triangles.
+*/
+qltload *Qltload(const char *fname,int batch,void (*onpublish)(void *arg),void *arg);
+/*
+Takes the triangles handed over since the last call into scene (whose tris list stays NULL-terminated and whose
+address never changes). Call it from the rendering thread, between frames. Returns the number of triangles in scene.
+*/
+int qltloadpoll(qltload *load);
+/*Records that a frame of the current scene was drawn, for the firstframe and fullframe metrics*/
+void qltloadframe(qltload *load);
+/*Waits until the loader thread is finished (the triangles still have to be taken with qltloadpoll)*/
+void qltloadwait(qltload *load);
+/*Stops the loader thread and frees a qltload object and its triangles*/
+void freeqltload(qltload **load);
+
 #endif
\ No newline at end of file
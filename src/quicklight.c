@@ -1,7 +1,10 @@
 #include "./quicklight.h"
+#include "./qlvect.h"
+#include "./qlstats.h"
 #include <stdlib.h>
 #include <stdio.h>
 #include <math.h>
+#include <string.h>
 /*
 Copyright (c) 2020 Amélia O. F. da S.
 
@@ -24,21 +27,6 @@ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
 SOFTWARE.
 */
 
-/*
-The following vectors are general-purpose vectors used under many different names by the functions below.
-This makes it so they don't have to spend cycles allocating and freeing memory for temporary vectors.
-*/
-qlvect _qlgp0={0,0,0};
-qlvect _qlgp1={0,0,0};
-qlvect _qlgp2={0,0,0};
-qlvect _qlgp3={0,0,0};
-qlvect _qlgp4={0,0,0};
-
-qlvect _qlgpm0={0,0,0};
-qlvect _qlgpm1={0,0,0};
-qlvect _qlgpm2={0,0,0};
-qlvect _qlgpm3={0,0,0};
-
 qlvect qlx={1,0,0};
 qlvect qly={0,1,0};
 qlvect qlz={0,0,1};
@@ -51,18 +39,45 @@ qlraster* Qlraster(int w, int h, int s)
 {
     qlraster *ret=malloc(sizeof(qlraster));
     ret->data=malloc(w*h*s);
+    ret->z=malloc(w*h*sizeof(double));
     ret->w=w;
     ret->h=h;
     ret->s=s;
+    ret->fmt=s==4?QL_XRGB32:QL_RGB24;
     return ret;
 }
 void freeqlraster(qlraster** obj)
 {
     if(!obj||!(*obj))return;
     if((*obj)->data)free((*obj)->data);
+    if((*obj)->z)free((*obj)->z);
     free(*obj);
     *obj=NULL;
 }
+void qlrastersetformat(qlraster *raster,int fmt)
+{
+    if(!raster||raster->fmt==fmt)return;
+    raster->s=fmt==QL_RGB24?3:4;
+    raster->fmt=fmt;
+    free(raster->data);
+    raster->data=calloc(raster->w*raster->h,raster->s);
+}
+
+int qlrasterwriteppm(const qlraster *raster,FILE *f)
+{
+    int i,length;
+    unsigned char rgb[3];
+    if(!raster||!f)return -1;
+    length=raster->w*raster->h;
+    fprintf(f,"P6\n%d %d\n255\n",raster->w,raster->h);
+    if(raster->fmt==QL_RGB24)return fwrite(raster->data,3,length,f)==(size_t)length?0:-1;
+    for(i=0;i<length;i++)
+    {
+        qlgetpixel(raster,i,rgb);
+        if(fwrite(rgb,1,3,f)!=3)return -1;
+    }
+    return 0;
+}
 
 qlvect* Qlvect(double x, double y, double z)
 {
@@ -98,155 +113,229 @@ qlcamera *Qlcamera(qlraster *image,const qlvect *pos,const qlvect *dir,const dou
 {
     if(!image||!pos||!dir)return NULL;
     qlcamera *ret=malloc(sizeof(qlcamera));
-    qlvect *rpos=&_qlgpm0,*rdir=&_qlgpm1,*focalpoint=&_qlgpm3;
+    qlvect rpos={0,0,0},rdir=qlvscale(*dir,fl);
     int length=image->h*image->w;
     int i,x,y;
     ret->pos=*pos;
-    ret->dir=*dir;
-    qlvectnormalize(&ret->dir);
+    ret->dir=qlvnormalize(*dir);
     ret->image=image;
     ret->fl=fl;
     ret->w=w;
     ret->h=h;
     ret->roll=roll;
     ret->depth=depth;
+    ret->znorm=0;
+    ret->order=QL_ORDER_ROWS;
+    ret->tile=QL_ORDER_TILE;
+    ret->trav=malloc(length*sizeof(int));
 
-    /*We first define the focal point of the camera*/
-    qlvectscale(dir,fl,rdir);
-    qlvectsub(pos,rdir,focalpoint);
-
-    ret->rays=malloc(length*sizeof(qlray));
+    ret->rays=malloc(length*sizeof(qlray*));
     for(i=0;i<length;i++)
     {
         x=i%image->w;
-        y=floor(i/image->w);
-        ret->rays[i]=Qlray(image,x,y,rpos,rdir);
+        y=i/image->w;
+        ret->rays[i]=Qlray(image,x,y,&rpos,&rdir);
     }
     qlupdatecamera(ret);
     return ret;
 }
+void qlcamerasetorder(qlcamera *camera,char order,int tile)
+{
+    if(!camera)return;
+    int length=camera->image->h*camera->image->w;
+    int i,n;
+    camera->order=order;
+    camera->tile=tile>0?tile:QL_ORDER_TILE;
+    /*Allocating the rays in traversal order keeps the ones traced one after the other next to each other in memory*/
+    for(i=0;i<length;i++)free(camera->rays[i]);
+    n=qltraversal(camera,0,camera->image->h,camera->trav);
+    for(i=0;i<n;i++)
+        camera->rays[camera->trav[i]]=Qlray(camera->image,camera->trav[i]%camera->image->w,camera->trav[i]/camera->image->w,&camera->pos,&camera->dir);
+    qlupdatecamera(camera);
+}
+/*Gathers the even bits of c (the x coordinate of a Morton code; c>>1 gives the y coordinate)*/
+static inline int qlmortoncompact(unsigned int c)
+{
+    c&=0x55555555;
+    c=(c|(c>>1))&0x33333333;
+    c=(c|(c>>2))&0x0f0f0f0f;
+    c=(c|(c>>4))&0x00ff00ff;
+    c=(c|(c>>8))&0x0000ffff;
+    return c;
+}
+int qltraversal(const qlcamera *camera,int y0,int y1,int *out)
+{
+    if(!camera||!out)return 0;
+    int w=camera->image->w,t=camera->tile,n=0;
+    int i,x,y,tx,ty,c;
+    if(y0<0)y0=0;
+    if(y1>camera->image->h)y1=camera->image->h;
+    if(camera->order==QL_ORDER_ROWS||t<=0)
+    {
+        for(i=y0*w;i<y1*w;i++)out[n++]=i;
+        return n;
+    }
+    if(camera->order==QL_ORDER_MORTON)
+    {
+        for(i=1;i<t;i<<=1);
+        t=i;
+    }
+    for(ty=y0;ty<y1;ty+=t)
+        for(tx=0;tx<w;tx+=t)
+        {
+            if(camera->order==QL_ORDER_MORTON)
+            {
+                for(c=0;c<t*t;c++)
+                {
+                    x=tx+qlmortoncompact(c);
+                    y=ty+qlmortoncompact(c>>1);
+                    if(x<w&&y<y1)out[n++]=x+y*w;
+                }
+            }
+            else
+            {
+                for(y=ty;y<ty+t&&y<y1;y++)
+                    for(x=tx;x<tx+t&&x<w;x++)out[n++]=x+y*w;
+            }
+        }
+    return n;
+}
 
 void qlupdatecamera(qlcamera *camera)
 {
     if(!camera)return;
-    qlvect *rpos=&_qlgpm0,*rdir=&_qlgpm1,*rotaxis=&_qlgpm2,*focalpoint=&_qlgpm3;
-    int length=camera->image->h*camera->image->w;
-    int i,x,y;
+    qlvect rpos,focalpoint,rotaxis;
+    double angle;
+    int length,i,x,y;
+    qlray *ray;
+    QL_STAT_TIMER(t);
 
     /*We first define the focal point of the camera*/
-    qlvectscale(&camera->dir,camera->fl,rdir);
-    qlvectsub(&camera->pos,rdir,focalpoint);
+    focalpoint=qlvsub(camera->pos,qlvscale(camera->dir,camera->fl));
+    /*The rotation that aligns (0,0,1) with the camera's normal vector is the same for every ray*/
+    rotaxis=qlvcross(camera->dir,qlz);
+    angle=acos(qlvdot(camera->dir,qlz));
 
+    length=qltraversal(camera,0,camera->image->h,camera->trav);
     for(i=0;i<length;i++)
     {
-        x=i%camera->image->w;
-        y=floor(i/camera->image->w);
+        ray=camera->rays[camera->trav[i]];
+        x=ray->rx;
+        y=ray->ry;
         /*First we place the vector as if the camera was pointing upwards, that is, (0,0,1) at (0,0,0)*/
-        rpos->x=(-(camera->w/2))+((camera->w/(camera->image->w-1))*x);
-        rpos->y=(-(camera->h/2))+((camera->h/(camera->image->h-1))*y);
-        rpos->z=0;
+        rpos=qlv((-(camera->w/2))+((camera->w/(camera->image->w-1))*x),(-(camera->h/2))+((camera->h/(camera->image->h-1))*y),0);
         /*Then we rotate them so they align with the camera's normal vector*/
-        qlvectproduct(&camera->dir,&qlz,rotaxis);
-        qlvectrotateaxis(rpos,rotaxis,acos(qlscproduct(&camera->dir,&qlz)));
+        rpos=qlvrotateaxis(rpos,rotaxis,angle);
         /*Then we roll them to the specified roll*/
-        qlvectrotateaxis(rpos,&camera->dir,camera->roll);
+        rpos=qlvrotateaxis(rpos,camera->dir,camera->roll);
         /*Then displace them to the camera position*/
-        qlvectsum(rpos,&camera->pos,rpos);
+        rpos=qlvsum(rpos,camera->pos);
         /*Now we have positioned the ray, let's find its direction.*/
-        qlvectsub(rpos,focalpoint,rdir);
-        qlvectnormalize(rdir);
-        camera->rays[i]->dir=*rdir;
-        camera->rays[i]->pos=*rpos;
-        camera->rays[i]->depth=camera->depth;
+        ray->dir=qlvnormalize(qlvsub(rpos,focalpoint));
+        ray->pos=rpos;
+        ray->depth=camera->depth;
     }
+    QL_STAT_TIME(QL_STAGE_CAMERA,t);
+}
+
+void qlcamerabasis(const qlcamera *camera,qlvect *ex,qlvect *ey)
+{
+    if(!camera||!ex||!ey)return;
+    /*The same rotations qlupdatecamera applies to each ray's position (they are linear, so they carry over to the axes)*/
+    qlvect rotaxis=qlvcross(camera->dir,qlz);
+    double angle=acos(qlvdot(camera->dir,qlz));
+    *ex=qlvrotateaxis(qlvrotateaxis(qlx,rotaxis,angle),camera->dir,camera->roll);
+    *ey=qlvrotateaxis(qlvrotateaxis(qly,rotaxis,angle),camera->dir,camera->roll);
+}
+
+void qlgetcamerastate(const qlcamera *camera,qlcamerastate *state)
+{
+    memset(state,0,sizeof(qlcamerastate));
+    state->pos=camera->pos;
+    state->dir=camera->dir;
+    state->roll=camera->roll;
+    state->fl=camera->fl;
+    state->w=camera->w;
+    state->h=camera->h;
+    state->depth=camera->depth;
+}
+
+void qlsetcamerastate(qlcamera *camera,const qlcamerastate *state)
+{
+    camera->pos=state->pos;
+    camera->dir=state->dir;
+    camera->roll=state->roll;
+    camera->fl=state->fl;
+    camera->w=state->w;
+    camera->h=state->h;
+    camera->depth=state->depth;
+    qlupdatecamera(camera);
 }
 
 void freeqlcamera(qlcamera **camera)
 {
     if(!camera||!(*camera))return;
     int i,s;
-    s=(*camera)->image->h*(*camera)->image->w*(*camera)->image->s;
+    s=(*camera)->image->h*(*camera)->image->w;
     for(i=0;i<s;i++)free((*camera)->rays[i]);
+    free((*camera)->rays);
+    free((*camera)->trav);
     free(*camera);
     *camera=NULL;
 }
 
 /*
 Vector functions
+These are wrappers around the inline functions in qlvect.h
 */
 double qlscproduct(const qlvect *a,const qlvect *b)
 {
     if(!a||!b)return -1;
-    return a->x*b->x+a->y*b->y+a->z*b->z;
+    return qlvdot(*a,*b);
 }
 
 void qlvectproduct(const qlvect *a,const qlvect *b,qlvect *c)
 {
     if(!a||!b||!c)return;
-    qlvect *temp=&_qlgp4;
-    temp->x=a->y*b->z-a->z*b->y;
-    temp->y=a->z*b->x-a->x*b->z;
-    temp->z=a->x*b->y-a->y*b->x;
-    c->x=temp->x;
-    c->y=temp->y;
-    c->z=temp->z;
+    *c=qlvcross(*a,*b);
 }
 
 void qlvectscale(const qlvect *a,double s,qlvect *b)
 {
     if(!a||!b)return;
-    b->x=a->x*s;
-    b->y=a->y*s;
-    b->z=a->z*s;
+    *b=qlvscale(*a,s);
 }
 
 void qlvectsum(const qlvect *a,const qlvect *b, qlvect *c)
 {
     if(!a||!b||!c)return;
-    c->x=a->x+b->x;
-    c->y=a->y+b->y;
-    c->z=a->z+b->z;
+    *c=qlvsum(*a,*b);
 }
 
 void qlvectsub(const qlvect *a,const qlvect *b, qlvect *c)
 {
     if(!a||!b||!c)return;
-    c->x=a->x-b->x;
-    c->y=a->y-b->y;
-    c->z=a->z-b->z;
+    *c=qlvsub(*a,*b);
 }
 
 void qlvectnormalize(qlvect *a)
 {
-    double sf=sqrt(qlscproduct(a,a));
-    a->x=a->x/sf;
-    a->y=a->y/sf;
-    a->z=a->z/sf;
+    if(!a)return;
+    *a=qlvnormalize(*a);
 }
 
 /*See https://en.wikipedia.org/wiki/Rotation_matrix#In_three_dimensions - General Rotations*/
 void qlvectrotate(qlvect *a,double rx,double ry,double rz)
 {
-    double srx=sin(rx),sry=sin(ry),srz=sin(rz),crx=cos(rx),cry=cos(ry),crz=cos(rz);
-    qlvect* tmp=&_qlgp0;
-    tmp->x=(a->x*(crz*cry))+(a->y*(crz*sry*srx-srz*crx))+(a->z*(crz*sry*crx+srz*srx));
-    tmp->y=(a->x*(srz*cry))+(a->y*(srz*sry*srx+crz*crx))+(a->z*(srz*sry*crx-crz*srx));
-    tmp->z=(a->x*(-sry))+(a->y*(cry*srx))+(a->z*(cry*crx));
-    a->x=tmp->x;
-    a->y=tmp->y;
-    a->z=tmp->z;
+    if(!a)return;
+    *a=qlvrotate(*a,rx,ry,rz);
 }
 
 /*See https://en.wikipedia.org/wiki/Rodrigues%27_rotation_formula*/
 void qlvectrotateaxis(qlvect *a,const qlvect *r,double rv)
 {
-    qlvect* res=&_qlgp0,*temp=&_qlgp1;
-    qlvectscale(a,cos(rv),res);
-    qlvectproduct(r,a,temp);
-    qlvectscale(temp,sin(rv),temp);
-    qlvectsum(res,temp,res);
-    qlvectscale(r,qlscproduct(r,a)*(1-cos(rv)),temp);
-    qlvectsum(res,temp,a);
+    if(!a||!r)return;
+    *a=qlvrotateaxis(*a,*r,rv);
 }
 
 /*
@@ -256,117 +345,136 @@ Vector-Triangle functions
 /*See https://en.wikipedia.org/wiki/Line%E2%80%93plane_intersection - Algebraic Form*/
 double qlvectintersect(const qlvect *pos,const qlvect *dir,const qltri *t)
 {
-    if(!pos||!dir||!t)return 0;
-    qlvect *result=&_qlgp0;
-    qlvect *normal=&_qlgp1;
-    qlvect *edge1=&_qlgp2;
-    qlvect *edge2=&_qlgp3;
-    double s;
-    /*First we calculate the vectors corresponding to the edges of the triangle*/
-    qlvectsub(&t->a,&t->b,edge1);
-    qlvectsub(&t->a,&t->c,edge2);
-    /*Then the normal*/
-    qlvectproduct(edge1,edge2,normal);
-    s=qlscproduct(dir,normal);
-    /*If the vector is parallel to the plane*/
-    if(s==0)return INFINITY;
-    qlvectsub(&t->a,pos,result);
-    s=qlscproduct(result,normal)/s;
-    return s;
+    if(!t)return 0;
+    return qlvectintersectv(pos,dir,&t->a,&t->b,&t->c);
+}
+double qlvectintersectv(const qlvect *pos,const qlvect *dir,const qlvect *a,const qlvect *b,const qlvect *c)
+{
+    if(!pos||!dir||!a||!b||!c)return 0;
+    return qlvintersect(*pos,*dir,*a,*b,*c);
 }
 char qlvectintri(const qlvect *a,const qltri *t)
 {
-    if(!a||!t)return -1;
-    /*A vector representing the edge we are currently analysing*/
-    qlvect *edge=&_qlgp0;
-    /*A vector starting on the first vertex of the edge and ending on our point*/
-    qlvect *vp=&_qlgp1;
-    /*A normal vector. We'll use it for checking if the other vectors point roughly towards the same direction*/
-    qlvect *normal=&_qlgp2;
-    /*Result vector*/
-    qlvect *result=&_qlgp3;
-    double reference;/*Scalar product of the first vector and the normal vector*/
-    /*AB edge*/
-    qlvectsub(&t->a,&t->b,edge);
-
-    /*We'll use this opportunity to calculate the normal vector, too*/
-    qlvectsub(&t->a,&t->c,vp);
-    qlvectproduct(vp,edge,normal);
-
-    qlvectsub(a,&t->a,vp);
-    qlvectproduct(vp,edge,result);
-    reference=qlscproduct(result,normal);
-    /*BC edge*/
-    qlvectsub(&t->b,&t->c,edge);
-    qlvectsub(a,&t->b,vp);
-    qlvectproduct(vp,edge,result);
-    if(qlscproduct(result,normal)*reference<0)return 0;
-    /*CA edge*/
-    qlvectsub(&t->c,&t->a,edge);
-    qlvectsub(a,&t->c,vp);
-    qlvectproduct(vp,edge,result);
-    if(qlscproduct(result,normal)*reference<0)return 0;
-    return 1;
+    if(!t)return -1;
+    return qlvectintriv(a,&t->a,&t->b,&t->c);
+}
+char qlvectintriv(const qlvect *p,const qlvect *a,const qlvect *b,const qlvect *c)
+{
+    if(!p||!a||!b||!c)return -1;
+    return qlvintri(*p,*a,*b,*c);
 }
 
 /*Raycasting functions*/
 
-double pmaxs=0;
-double maxs=0;
+double qlshadepercentile=0.98;
+double qlshadesmoothing=0.5;
 
 #ifndef QL_CUSTOM_RAYS
 void qlcalcray(qlray *ray,const qltri**triangles)
 {
-    int i=0;
-    double s;
-    double min=__DBL_MAX__;
-    qlvect *pos=&_qlgpm0,*dir=&_qlgpm1;
-    if(!ray||!triangles||!(triangles[0]))return;
-    double S=0.0;
-    double bright;
-    while(triangles[i]!=NULL)
-    {
-        *dir=ray->dir;
-        qlvectnormalize(dir);
-        s=qlvectintersect(&ray->pos,dir,triangles[i]);
-        if(s>=0&&s<min&&s<ray->depth)
+    int i;
+    double s,min=INFINITY;
+    qlvect dir;
+    const qltri *t;
+    if(!ray||!triangles)return;
+    int p=ray->rx+ray->ry*ray->screen->w;
+    QL_STAT_INC(rays);
+    dir=qlvnormalize(ray->dir);
+    for(i=0;(t=triangles[i])!=NULL;i++)
+        if((s=qlvhit(ray->pos,dir,t->a,t->b,t->c,min<ray->depth?min:ray->depth))<INFINITY)
         {
-            qlvectscale(dir,s,dir);
-            qlvectsum(&ray->pos,dir,pos);
-            if(qlvectintri(pos,triangles[i]))
-            {
-                maxs=maxs>s?maxs:s;
-                min=s;
-                bright=s<maxs?(s/maxs):1;
-                bright=(S+((1-S)*(1-bright)));
-                ray->screen->data[(ray->rx+ray->ry*ray->screen->w)*ray->screen->s]=(unsigned char)triangles[i]->colour[0]*bright;
-                ray->screen->data[(ray->rx+ray->ry*ray->screen->w)*ray->screen->s+1]=(unsigned char)triangles[i]->colour[1]*bright;
-                ray->screen->data[(ray->rx+ray->ry*ray->screen->w)*ray->screen->s+2]=(unsigned char)triangles[i]->colour[2]*bright;
-            }
+            min=s;
+            qlputpixel(ray->screen,p,t->colour[0],t->colour[1],t->colour[2]);
         }
-        i++;
+    ray->screen->z[p]=min;
+    if(min>ray->depth)qlputpixel(ray->screen,p,0,0,0);
+}
+#endif
+void qltracerowswith(qlcamera *camera,void (*calcray)(qlray *ray,const void *arg),const void *arg,int y0,int y1)
+{
+    if(!camera||!calcray)return;
+    int i,s;
+    int *order;
+    QL_STAT_TIMER(t);
+    if(camera->order==QL_ORDER_ROWS)
+    {
+        s=y1*camera->image->w;
+        for(i=y0*camera->image->w;i<s;i++)
+            calcray(camera->rays[i],arg);
     }
-    if(min>ray->depth)
+    else
     {
-        ray->screen->data[(ray->rx+ray->ry*ray->screen->w)*ray->screen->s]=0;
-        ray->screen->data[(ray->rx+ray->ry*ray->screen->w)*ray->screen->s+1]=0;
-        ray->screen->data[(ray->rx+ray->ry*ray->screen->w)*ray->screen->s+2]=0;
+        order=camera->trav+y0*camera->image->w;
+        s=qltraversal(camera,y0,y1,order);
+        for(i=0;i<s;i++)
+            calcray(camera->rays[order[i]],arg);
     }
+    QL_STAT_TIME(QL_STAGE_TRACE,t);
+}
+static void qlcalcrayarg(qlray *ray,const void *triangles)
+{
+    qlcalcray(ray,(const qltri**)triangles);
+}
+void qltracerows(qlcamera *camera,const qltri**triangles,int y0,int y1)
+{
+    if(!camera||!triangles)return;
+    qltracerowswith(camera,qlcalcrayarg,triangles,y0,y1);
 }
-#endif
 #ifndef QL_CUSTOM_STEP
 void qlstep(qlcamera *camera,const qltri**triangles)
 {
     if(!camera||!triangles||!triangles[0])return;
-    int i,s;
-    maxs=(8*pmaxs)/10;
-    s=camera->image->h*camera->image->w*camera->image->s;
-    for(i=0;i<s;i++)
-        qlcalcray(camera->rays[i],triangles);
-    pmaxs=maxs;
+    qltracerows(camera,triangles,0,camera->image->h);
+    qlshade(camera);
 }
 #endif
 
+/*Number of buckets of the depth histogram*/
+#define QL_SHADE_BINS 256
+
+void qlshade(qlcamera *camera)
+{
+    if(!camera)return;
+    qlraster *image=camera->image;
+    int hist[QL_SHADE_BINS]={0};
+    int i,j,b,hits=0,length=image->w*image->h;
+    double z,norm,bright;
+    unsigned char rgb[3];
+    QL_STAT_TIMER(t);
+    /*Hits are always closer than the camera depth, so the histogram spans [0,depth)*/
+    for(i=0;i<length;i++)
+    {
+        z=image->z[i];
+        if(!(z<camera->depth))continue;
+        b=(z/camera->depth)*QL_SHADE_BINS;
+        hist[b<QL_SHADE_BINS?b:QL_SHADE_BINS-1]++;
+        hits++;
+    }
+    if(hits)
+    {
+        /*Upper edge of the bucket holding the qlshadepercentile-th hit*/
+        j=0;
+        for(b=0;b<QL_SHADE_BINS-1;b++)
+        {
+            j+=hist[b];
+            if(j>=qlshadepercentile*hits)break;
+        }
+        norm=camera->depth*(b+1)/QL_SHADE_BINS;
+        if(camera->znorm>0)norm=qlshadesmoothing*camera->znorm+(1-qlshadesmoothing)*norm;
+        camera->znorm=norm;
+    }
+    else norm=camera->znorm;
+    for(i=0;i<length;i++)
+    {
+        z=image->z[i];
+        if(!(z<camera->depth))continue;
+        bright=z<norm?1-(z/norm):0;
+        qlgetpixel(image,i,rgb);
+        qlputpixel(image,i,rgb[0]*bright,rgb[1]*bright,rgb[2]*bright);
+    }
+    QL_STAT_TIME(QL_STAGE_SHADE,t);
+}
+
 /*Interaction functions*/
 
 double walktick=0.3;
@@ -375,57 +483,57 @@ double fltick=0.1;
 
 void qlcameractl(qlcamera *camera,char c)
 {
-    qlvect *dir=&_qlgpm0,*norm=&_qlgpm1;
+    qlvect dir,norm;
     if(c)
     {
         switch (c)
         {
         case 'w':
-            qlvectscale(&camera->dir,walktick,dir);
-            qlvectsum(&camera->pos,dir,&camera->pos);
+            dir=qlvscale(camera->dir,walktick);
+            camera->pos=qlvsum(camera->pos,dir);
             break;
         case 's':
-            qlvectscale(&camera->dir,-walktick,dir);
-            qlvectsum(&camera->pos,dir,&camera->pos);
+            dir=qlvscale(camera->dir,-walktick);
+            camera->pos=qlvsum(camera->pos,dir);
             break;
         case 'a':
-            qlvectscale(&camera->dir,walktick,dir);
-            qlvectrotate(dir,0,0,-QL_PI/2);
-            qlvectsum(&camera->pos,dir,&camera->pos);
+            dir=qlvscale(camera->dir,walktick);
+            dir=qlvrotate(dir,0,0,-QL_PI/2);
+            camera->pos=qlvsum(camera->pos,dir);
             break;
         case 'd':
-            qlvectscale(&camera->dir,walktick,dir);
-            qlvectrotate(dir,0,0,QL_PI/2);
-            qlvectsum(&camera->pos,dir,&camera->pos);
+            dir=qlvscale(camera->dir,walktick);
+            dir=qlvrotate(dir,0,0,QL_PI/2);
+            camera->pos=qlvsum(camera->pos,dir);
             break;
         case 't':
-            qlvectscale(&camera->dir,walktick,dir);
-            qlvectproduct(dir,&qlz,norm);
-            qlvectrotateaxis(dir,norm,QL_PI/2);
-            qlvectsum(&camera->pos,dir,&camera->pos);
+            dir=qlvscale(camera->dir,walktick);
+            norm=qlvcross(dir,qlz);
+            dir=qlvrotateaxis(dir,norm,QL_PI/2);
+            camera->pos=qlvsum(camera->pos,dir);
             break;
         case 'g':
-            qlvectscale(&camera->dir,walktick,dir);
-            qlvectproduct(dir,&qlz,norm);
-            qlvectrotateaxis(dir,norm,-QL_PI/2);
-            qlvectsum(&camera->pos,dir,&camera->pos);
+            dir=qlvscale(camera->dir,walktick);
+            norm=qlvcross(dir,qlz);
+            dir=qlvrotateaxis(dir,norm,-QL_PI/2);
+            camera->pos=qlvsum(camera->pos,dir);
             break;
         case 'q':
-            qlvectrotate(&camera->dir,0,0,-rottick);
+            camera->dir=qlvrotate(camera->dir,0,0,-rottick);
             camera->roll+=rottick;
             break;
         case 'e':
-            qlvectrotate(&camera->dir,0,0,rottick);
+            camera->dir=qlvrotate(camera->dir,0,0,rottick);
             camera->roll-=rottick;
             break;
          case 'r':
-            qlvectproduct(&camera->dir,&qlz,norm);
-            qlvectrotateaxis(&camera->dir,norm,rottick);
+            norm=qlvcross(camera->dir,qlz);
+            camera->dir=qlvrotateaxis(camera->dir,norm,rottick);
             //camera->roll-=rottick*sqrt(qlscproduct(norm,norm));
             break;
         case 'f':
-            qlvectproduct(&camera->dir,&qlz,norm);
-            qlvectrotateaxis(&camera->dir,norm,-rottick);
+            norm=qlvcross(camera->dir,qlz);
+            camera->dir=qlvrotateaxis(camera->dir,norm,-rottick);
             //camera->roll+=rottick*sqrt(qlscproduct(norm,norm));
             break;
         case 'z':
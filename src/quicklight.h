@@ -24,25 +24,69 @@ SOFTWARE.
 
 #ifndef QUICKLIGHT
 #define QUICKLIGHT
+#include <stdio.h>
 #define QL_PI 3.14159265358979323846
 /*Data structures and allocation functions*/
 
+/*Pixel formats*/
+/*3 bytes per pixel: R, G, B*/
+#define QL_RGB24 0
+/*One native-endian 32-bit word per pixel: (r<<16)|(g<<8)|b (the most common X11 TrueColor layout)*/
+#define QL_XRGB32 1
+/*One native-endian 32-bit word per pixel: (b<<16)|(g<<8)|r*/
+#define QL_XBGR32 2
+
 /*
 A raster image.
 */
 typedef struct _qlraster {
-    char* data;/*Raster data. 0-th byte belongs to the top left pixel. (w*s)-th byte belongs to the leftmost pixel of the second line.*/
+    unsigned char* data;/*Raster data. 0-th byte belongs to the top left pixel. (w*s)-th byte belongs to the leftmost pixel of the second line.*/
     int w;/*Width, in pixels*/
     int h;/*Height, in pixels*/
     int s;/*size of each pixel (e.g. 3 for 0-255 RGB pixels)*/
+    int fmt;/*Pixel format (QL_RGB24 for s=3, QL_XRGB32 or QL_XBGR32 for s=4)*/
+    double *z;/*Depth plane. Distance from the ray's origin to the nearest hit of each pixel (INFINITY where nothing was hit)*/
 }qlraster;
 /*
 Instantiates a qlraster object.
+s=3 creates a QL_RGB24 raster and s=4 a QL_XRGB32 one.
 One should use the freeqlraster to free its memory (as it allocates memory for storing the image data)
 */
 qlraster* Qlraster(int w, int h, int s);
 /*Frees a qlraster object*/
 void freeqlraster(qlraster** obj);
+/*Changes a raster's pixel format. The image data is reallocated, and its contents are lost.*/
+void qlrastersetformat(qlraster *raster,int fmt);
+/*Sets the i-th pixel of a raster (i=x+y*w)*/
+static inline void qlputpixel(qlraster *raster,int i,unsigned char r,unsigned char g,unsigned char b)
+{
+    if(raster->fmt==QL_XRGB32)((unsigned int*)raster->data)[i]=(r<<16)|(g<<8)|b;
+    else if(raster->fmt==QL_XBGR32)((unsigned int*)raster->data)[i]=(b<<16)|(g<<8)|r;
+    else
+    {
+        raster->data[i*3]=r;
+        raster->data[i*3+1]=g;
+        raster->data[i*3+2]=b;
+    }
+}
+/*Outputs the i-th pixel of a raster (i=x+y*w) as R, G and B at rgb*/
+static inline void qlgetpixel(const qlraster *raster,int i,unsigned char *rgb)
+{
+    unsigned int p;
+    if(raster->fmt==QL_RGB24)
+    {
+        rgb[0]=raster->data[i*3];
+        rgb[1]=raster->data[i*3+1];
+        rgb[2]=raster->data[i*3+2];
+        return;
+    }
+    p=((const unsigned int*)raster->data)[i];
+    rgb[0]=raster->fmt==QL_XRGB32?p>>16:p;
+    rgb[1]=p>>8;
+    rgb[2]=raster->fmt==QL_XRGB32?p:p>>16;
+}
+/*Writes a qlraster object to f as a binary (P6) PPM image (in any pixel format). Returns 0 on success and -1 on errors.*/
+int qlrasterwriteppm(const qlraster *raster,FILE *f);
 
 /*
 A vector object.
@@ -81,6 +125,13 @@ typedef struct _qltri {
 /*Instantiates a qltri object. Vectors will be copied to the triangle, not passed by reference.*/
 qltri* Qltri(const qlvect *a,const qlvect *b,const qlvect *c);
 
+/*Pixel traversal orders for the trace stage (see qlcamerasetorder)*/
+#define QL_ORDER_ROWS 0 /*Row-major, the raster's own layout*/
+#define QL_ORDER_TILES 1 /*Square tiles, row-major inside each tile*/
+#define QL_ORDER_MORTON 2 /*Square tiles, Z-order (Morton) curve inside each tile*/
+/*Default tile side for QL_ORDER_TILES and QL_ORDER_MORTON*/
+#define QL_ORDER_TILE 16
+
 /*
 A camera object.
 One should free its memory with freeqlcamera, as it allocates many ray objects which might not be freed automatically.
@@ -95,6 +146,10 @@ typedef struct _qlcamera{
     double w;/*Camera width in "real-world" units (same units as the vectors)*/
     double h;/*Camera height in "real-world" units (same units as the vectors)*/
     double depth;/*Depth at which rays respawn*/
+    double znorm;/*Distance shaded as black by qlshade (smoothed over frames)*/
+    char order;/*Pixel traversal order (QL_ORDER_*). Change it with qlcamerasetorder*/
+    int tile;/*Tile side in pixels for the tiled orders*/
+    int *trav;/*Scratch space for qltraversal (one index per pixel)*/
 } qlcamera;
 /*
 Generates a qlcamera object from a qlraster object and parameters.
@@ -111,6 +166,33 @@ rnd defines the amplitude of the random starting length of the rays
 void qlupdatecamera(qlcamera *camera);
 /*Frees a qlcamera object*/
 void freeqlcamera(qlcamera **camera);
+/*
+Outputs the axes of the camera's image plane: a ray at pixel (x,y) starts at
+pos + ex*(x*w/(image->w-1)-w/2) + ey*(y*h/(image->h-1)-h/2)
+*/
+void qlcamerabasis(const qlcamera *camera,qlvect *ex,qlvect *ey);
+/*
+Sets the order in which the camera's pixels are generated and traced.
+Tiles are tile x tile pixels (rounded up to a power of two for QL_ORDER_MORTON), visited in row-major order.
+The rays are reallocated in the new order, so that consecutive rays are also close in memory.
+*/
+void qlcamerasetorder(qlcamera *camera,char order,int tile);
+/*
+Writes to out the indices of the pixels in rows [y0,y1) in the camera's traversal order, and returns how many there are.
+Tiles start at row y0, so a band narrower than a tile is traced in clipped tiles.
+out must have room for (y1-y0)*image->w indices; camera->trav+y0*image->w is such a space, private to the band.
+*/
+int qltraversal(const qlcamera *camera,int y0,int y1,int *out);
+/*Camera parameters that change the rendered image (rays are derived from them)*/
+typedef struct _qlcamerastate{
+    qlvect pos;
+    qlvect dir;
+    double roll,fl,w,h,depth;
+} qlcamerastate;
+/*Copies a camera's parameters to state. Padding is zeroed, so states can be compared with memcmp.*/
+void qlgetcamerastate(const qlcamera *camera,qlcamerastate *state);
+/*Sets a camera's parameters from state (as they are: dir isn't normalized) and updates its rays*/
+void qlsetcamerastate(qlcamera *camera,const qlcamerastate *state);
 
 /*Vector functions*/
 
@@ -173,6 +255,10 @@ Calculates whether a point (vector) lies within the subspace defined by a triang
 Returns 1 when the point lies within the subspace and 0 otherwise (or -1 for errors).
 */
 char qlvectintri(const qlvect *a,const qltri *t);
+/*qlvectintersect for a triangle given by its vertices a, b and c*/
+double qlvectintersectv(const qlvect *pos,const qlvect *dir,const qlvect *a,const qlvect *b,const qlvect *c);
+/*qlvectintri (for point p) for a triangle given by its vertices a, b and c*/
+char qlvectintriv(const qlvect *p,const qlvect *a,const qlvect *b,const qlvect *c);
 
 /*Raycasting functions*/
 
@@ -181,22 +267,46 @@ char qlvectintri(const qlvect *a,const qltri *t);
 
 /*The following functions may be redefined by your own application*/
 #ifndef QL_CUSTOM_RAYS
-/*Calculates one cycle of a ray*/
+/*
+Calculates one cycle of a ray.
+Writes the unshaded colour of the nearest hit to the ray's pixel and its distance to the depth plane,
+so rays may be traced in any order. Brightness is applied afterwards by qlshade.
+*/
 void qlcalcray(qlray *ray,const qltri**triangles);
 #endif
+/*
+Cycles the camera's rays on rows [y0,y1) without shading them.
+Different row ranges of a camera may be traced by different threads at the same time.
+*/
+void qltracerows(qlcamera *camera,const qltri**triangles,int y0,int y1);
+/*
+Calls calcray(ray,arg) for each of the camera's rays on rows [y0,y1), in the camera's traversal order, timed as the trace stage.
+qltracerows and the ray casters of the other modules (sorted scenes, meshes) are built on it.
+*/
+void qltracerowswith(qlcamera *camera,void (*calcray)(qlray *ray,const void *arg),const void *arg,int y0,int y1);
 #ifndef QL_CUSTOM_STEP
-/*Cycles all the camera's rays*/
+/*Cycles all the camera's rays, then shades the image*/
 void qlstep(qlcamera *camera,const qltri**triangles);
 #endif
+/*
+Depth shading pass. Darkens every pixel of the camera's image according to its depth.
+The distance shaded as black is taken from a histogram of the frame's depth plane
+(the qlshadepercentile-th hit distance), blended with the previous frame's by qlshadesmoothing.
+*/
+void qlshade(qlcamera *camera);
+/*Fraction (0-1] of the hit pixels that are closer than the distance shaded as black*/
+extern double qlshadepercentile;
+/*Weight (0-1) of the previous frame's normalization distance (0 disables temporal smoothing)*/
+extern double qlshadesmoothing;
 
 /*Interaction functions*/
 
 /*Multiplier for the direction vector when translating the camera*/
-double walktick;
+extern double walktick;
 /*Rotation in radians for each camera update*/
-double rottick;
+extern double rottick;
 /*Focal length change rate for each camera update*/
-double fltick;
+extern double fltick;
 
 /*
 Updates the camera position according to a keyboard event c
@@ -212,10 +322,10 @@ void qlcameractl(qlcamera *camera,char c);
 
 /*Constants*/
 /*(1,0,0)*/
-qlvect qlx;
+extern qlvect qlx;
 /*(0,1,0)*/
-qlvect qly;
+extern qlvect qly;
 /*(0,0,1)*/
-qlvect qlz;
+extern qlvect qlz;
 
 #endif
\ No newline at end of file
@@ -0,0 +1,109 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../src/quicklight.h"
+#include "../src/qlscene.h"
+#include "../src/qlbatch.h"
+
+/*
+Renders several views of a terrain through a batch on a thread pool, moving every camera between frames,
+with and without occlusion culling. Each view's raster, and the PPM image it streams, must be byte for byte
+the same as a plain qlstep of the same camera with the whole triangle list.
+*/
+
+#define GRID 20 /*The terrain has GRID*GRID*2 triangles*/
+#define VIEWS 4
+#define THREADS 3
+
+int main()
+{
+	int x,y,i,v,f,fail=0,ntriangles=0;
+	qltri *triangles[GRID*GRID*2+1];
+	/*Sizes that aren't multiples of the batch's rows per job*/
+	const int sizes[VIEWS][2]={{40,30},{33,21},{16,9},{50,37}};
+	const char keys[]="wwqqweewraadwf";
+	qlcamera *cams[VIEWS],*plaincams[VIEWS];
+	qlraster *rasters[VIEWS],*plain[VIEWS];
+	FILE *out[VIEWS],*plainout[VIEWS];
+	char *outbuf[VIEWS],*plainbuf[VIEWS];
+	size_t outlen[VIEWS],plainlen[VIEWS];
+	srand(1);
+	for(y=0;y<GRID;y++)
+		for(x=0;x<GRID;x++)
+		{
+			qlvect a={x,y,(rand()%64)/32.0},b={x+1,y,(rand()%64)/32.0},c={x,y+1,(rand()%64)/32.0},d={x+1,y+1,(rand()%64)/32.0};
+			triangles[ntriangles]=Qltri(&a,&b,&c);
+			triangles[ntriangles]->colour[0]=x*8;
+			triangles[ntriangles++]->colour[1]=y*8;
+			triangles[ntriangles]=Qltri(&b,&d,&c);
+			triangles[ntriangles]->colour[1]=x*8;
+			triangles[ntriangles++]->colour[2]=y*8;
+		}
+	triangles[ntriangles]=NULL;
+
+	for(v=0;v<VIEWS;v++)
+	{
+		qlvect pos={2+v*5,2,5+v},dir={1,1+v*0.3,-0.4};
+		rasters[v]=Qlraster(sizes[v][0],sizes[v][1],3);
+		plain[v]=Qlraster(sizes[v][0],sizes[v][1],3);
+		cams[v]=Qlcamera(rasters[v],&pos,&dir,0,1,1,0.75,3*GRID);
+		plaincams[v]=Qlcamera(plain[v],&pos,&dir,0,1,1,0.75,3*GRID);
+		out[v]=open_memstream(&outbuf[v],&outlen[v]);
+		plainout[v]=open_memstream(&plainbuf[v],&plainlen[v]);
+	}
+	qlscene *scene=Qlscene(triangles);
+	qlbatch *batch=Qlbatch(cams,VIEWS,scene,THREADS);
+	if(!batch)return -1;
+	for(v=0;v<VIEWS;v++)qlbatchoutput(batch,v,out[v]);
+
+	for(f=0;keys[f];f++)
+	{
+		/*The second half of the frames is culled against the previous ones*/
+		if(f==(int)strlen(keys)/2)qlbatchocclusion(batch,1);
+		for(v=0;v<VIEWS;v++)
+		{
+			qlcameractl(cams[v],keys[(f+v)%strlen(keys)]);
+			qlcameractl(plaincams[v],keys[(f+v)%strlen(keys)]);
+		}
+		qlbatchrender(batch);
+		for(v=0;v<VIEWS;v++)
+		{
+			qlstep(plaincams[v],(const qltri**)triangles);
+			qlrasterwriteppm(plain[v],plainout[v]);
+			if(memcmp(rasters[v]->data,plain[v]->data,sizes[v][0]*sizes[v][1]*3))
+			{
+				printf("Frame %d, view %d differs!\n",f,v);
+				fail=1;
+			}
+		}
+	}
+
+	for(v=0;v<VIEWS;v++)
+	{
+		fclose(out[v]);
+		fclose(plainout[v]);
+		if(outlen[v]!=plainlen[v]||memcmp(outbuf[v],plainbuf[v],outlen[v]))
+		{
+			printf("The stream of view %d differs!\n",v);
+			fail=1;
+		}
+		printf("View %d: %dx%d, %zu bytes streamed\n",v,sizes[v][0],sizes[v][1],outlen[v]);
+		free(outbuf[v]);
+		free(plainbuf[v]);
+	}
+	printf("%d views, %d frames, %d threads\n",VIEWS,f,THREADS);
+
+	freeqlbatch(&batch);
+	freeqlscene(&scene);
+	for(v=0;v<VIEWS;v++)
+	{
+		freeqlcamera(&cams[v]);
+		freeqlcamera(&plaincams[v]);
+		freeqlraster(&rasters[v]);
+		freeqlraster(&plain[v]);
+	}
+	for(i=0;i<ntriangles;i++)free(triangles[i]);
+	if(fail)return -1;
+	printf("Ok.");
+	return 0;
+}
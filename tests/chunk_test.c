@@ -0,0 +1,133 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../src/quicklight.h"
+#include "../src/qslt.h"
+#include "../src/qlscene.h"
+#include "../src/qlchunk.h"
+#include "../src/qlstats.h"
+
+/*
+Writes a terrain to a chunk file and flies over it with a memory budget of a fraction of the terrain.
+Rendering goes on while chunks are missing. After waiting for the loader, every frame whose chunks in view fit
+in the budget must have all of them, and its depth must match the one rendered from the whole terrain in memory.
+*/
+
+#define GRID 60 /*The terrain has GRID*GRID*2 triangles*/
+#define CHUNK 10.0
+#define W 40
+#define H 30
+#define FNAME "build/chunk_test.qlc"
+
+int main()
+{
+	int x,y,i,f,k,fail=0,n;
+	unsigned long long t,worst=0;
+	size_t peak=0,biggest=0,inview;
+	int crowded=0;
+	qlfrustum frustum;
+	qltri *triangles[GRID*GRID*2+1];
+	const qltri **visible,**list;
+	int ntriangles=0;
+	const char keys[]="wwwwwwwwwwqqqqqqqqwwwwwwwweeeeeeeeeeeeeeeewwwwwwww";
+	srand(1);
+	for(y=0;y<GRID;y++)
+		for(x=0;x<GRID;x++)
+		{
+			/*Heights that are exact in single precision, so the chunk file holds the same terrain*/
+			qlvect a={x,y,(rand()%64)/32.0},b={x+1,y,(rand()%64)/32.0},c={x,y+1,(rand()%64)/32.0},d={x+1,y+1,(rand()%64)/32.0};
+			triangles[ntriangles]=Qltri(&a,&b,&c);
+			triangles[ntriangles]->colour[0]=x*4;
+			triangles[ntriangles++]->colour[1]=y*4;
+			triangles[ntriangles]=Qltri(&b,&d,&c);
+			triangles[ntriangles]->colour[1]=x*4;
+			triangles[ntriangles++]->colour[2]=y*4;
+		}
+	triangles[ntriangles]=NULL;
+	n=qlchunkwrite(FNAME,(const qltri**)triangles,CHUNK);
+	printf("%d triangles in %d chunks\n",ntriangles,n);
+	if(n<=0)return -1;
+
+	/*A quarter of the terrain fits in memory*/
+	qlchunks *chunks=Qlchunks(FNAME,sizeof(qltri)*ntriangles/4);
+	if(!chunks)
+	{
+		printf("Couldn't open %s!\n",FNAME);
+		return -1;
+	}
+	chunks->prefetch=CHUNK;
+	for(i=0;i<chunks->n;i++)if(chunks->chunks[i].bytes>biggest)biggest=chunks->chunks[i].bytes;
+
+	qlscene *scene=Qlscene(triangles);
+	visible=malloc(sizeof(qltri*)*(ntriangles+1));
+	qlraster *whole=Qlraster(W,H,3),*streamed=Qlraster(W,H,3);
+	qlvect pos={2,2,6},dir={1,1,-0.5};
+	qlcamera *wholecam=Qlcamera(whole,&pos,&dir,0,1,1,0.75,15);
+	qlcamera *streamedcam=Qlcamera(streamed,&pos,&dir,0,1,1,0.75,15);
+
+	/*The first frame doesn't wait: nothing is loaded yet, and it's rendered with whatever is there*/
+	list=qlchunksupdate(chunks,streamedcam);
+	printf("First frame: %d chunks in view missing, %d triangles traced\n",chunks->missing,qllen((void**)list));
+	qlstep(streamedcam,list);
+
+	for(f=0;keys[f];f++)
+	{
+		/*Five steps per frame, to cross the terrain*/
+		for(k=0;k<5;k++)
+		{
+			qlcameractl(wholecam,keys[f]);
+			qlcameractl(streamedcam,keys[f]);
+		}
+		/*Updating never waits for the disk*/
+		t=qlstatsnow();
+		qlchunksupdate(chunks,streamedcam);
+		t=qlstatsnow()-t;
+		if(t>worst)worst=t;
+		qlchunkswait(chunks);
+		list=qlchunksupdate(chunks,streamedcam);
+		if(chunks->resident>peak)peak=chunks->resident;
+		qlcamerafrustum(streamedcam,&frustum);
+		for(i=0,inview=0;i<chunks->n;i++)
+			if(qlfrustumsphere(&frustum,&chunks->chunks[i].center,chunks->chunks[i].radius))inview+=chunks->chunks[i].bytes;
+		if(inview>chunks->budget)
+		{
+			/*Some chunks in view have to be skipped*/
+			crowded++;
+			continue;
+		}
+		if(chunks->missing)
+		{
+			printf("Frame %d: %d chunks in view still missing!\n",f,chunks->missing);
+			fail=1;
+		}
+		qltracerows(streamedcam,list,0,H);
+		qlscenecull(scene,wholecam,visible);
+		qltracerows(wholecam,visible,0,H);
+		/*Ties between triangles may resolve differently in another order, but the depth can't*/
+		if(memcmp(whole->z,streamed->z,sizeof(double)*W*H))
+		{
+			printf("Frame %d differs!\n",f);
+			fail=1;
+		}
+	}
+	printf("%llu loads, %llu evictions, peak %zu of %zu bytes, slowest update %.3fms, %d frames over budget\n",
+		chunks->loads,chunks->evictions,peak,chunks->budget,worst/1e6,crowded);
+	if(peak>chunks->budget+biggest)
+	{
+		printf("Over budget!\n");
+		fail=1;
+	}
+
+	freeqlchunks(&chunks);
+	freeqlscene(&scene);
+	free(visible);
+	freeqlcamera(&wholecam);
+	freeqlcamera(&streamedcam);
+	freeqlraster(&whole);
+	freeqlraster(&streamed);
+	for(i=0;i<ntriangles;i++)free(triangles[i]);
+	remove(FNAME);
+	if(fail)return -1;
+	printf("Ok.");
+	return 0;
+}
@@ -0,0 +1,155 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <sys/socket.h>
+#include "../src/quicklight.h"
+#include "../src/qldist.h"
+#include "../src/qlstream.h"
+
+/*
+Renders a scene on three worker processes and compares every frame with qlstep's.
+The scene is much denser near the floor, so the bottom rows cost more and the bands have to be rebalanced.
+Halfway through, a worker is killed, and later another one hangs without closing its connection:
+their rows must be traced by the coordinator, and frames must still match.
+Last, a worker must refuse a request with an unknown pixel format.
+*/
+
+#define WORKERS 3
+#define TRIS 500
+#define W 48
+#define H 36
+#define ADDR "unix:build/dist_test.sock"
+#define BADADDR "unix:build/dist_test_bad.sock"
+#define TIMEOUT 300 /*Milliseconds the coordinator waits for a worker*/
+
+/*Sends a worker a request with pixel format fmt, and returns whether it answered*/
+int badrequest(qltri **triangles,int fmt)
+{
+	unsigned char request[4+6*4+11*8]={0},answer[4];
+	int i,status,answered,fd=qlstreamsocket(BADADDR,1),worker;
+	pid_t pid=qldistspawn(BADADDR,triangles);
+	const unsigned int fields[6]={1,16,16,fmt,0,16};
+	worker=accept(fd,NULL,NULL);
+	memcpy(request,"QLDR",4);
+	for(i=0;i<6*4;i++)request[4+i]=fields[i/4]>>(i%4*8);
+	/*A camera at the origin looking along x, with a focal length of 1 and a 1x1 image*/
+	request[4+6*4+3*8+7]=0x3f;
+	request[4+6*4+3*8+6]=0xf0;
+	for(i=7;i<11;i++)
+	{
+		request[4+6*4+i*8+7]=0x3f;
+		request[4+6*4+i*8+6]=0xf0;
+	}
+	qlsendall(worker,request,sizeof(request));
+	answered=!qlrecvall(worker,answer,4)&&!memcmp(answer,"QLDA",4);
+	close(worker);
+	waitpid(pid,&status,0);
+	close(fd);
+	remove("build/dist_test_bad.sock");
+	return answered;
+}
+
+int main()
+{
+	int i,f,n,fail=0;
+	pid_t pids[WORKERS];
+	qltri *triangles[TRIS+1];
+	const char keys[]="wwwwwaaaaaeeeeeeddddwwwwqqqqqqsssssssswwww";
+	srand(2);
+	for(i=0;i<TRIS;i++)
+	{
+		/*Nine in ten triangles lie near the floor*/
+		qlvect a={rand()%400/10.0,rand()%400/10.0,i%10?rand()%10/10.0:rand()%200/10.0};
+		qlvect b={a.x+0.5,a.y,a.z},c={a.x,a.y+0.5,a.z+0.5};
+		triangles[i]=Qltri(&a,&b,&c);
+		triangles[i]->colour[0]=i;
+		triangles[i]->colour[1]=i*3;
+		triangles[i]->colour[2]=i*7;
+	}
+	triangles[TRIS]=NULL;
+
+	qldist *dist=Qldist(ADDR);
+	if(!dist)
+	{
+		printf("Couldn't listen at %s!\n",ADDR);
+		return -1;
+	}
+	for(i=0;i<WORKERS;i++)pids[i]=qldistspawn(ADDR,triangles);
+	if(qldistaccept(dist,WORKERS)!=WORKERS)return -1;
+	qldisttimeout(dist,TIMEOUT);
+
+	qlraster *local=Qlraster(W,H,3),*remote=Qlraster(W,H,3);
+	qlvect pos={-5,-5,4},dir={1,1,-0.3};
+	qlcamera *localcam=Qlcamera(local,&pos,&dir,0,1,1,0.75,60);
+	qlcamera *remotecam=Qlcamera(remote,&pos,&dir,0,1,1,0.75,60);
+
+	for(f=0;keys[f];f++)
+	{
+		qlcameractl(localcam,keys[f]);
+		qlcameractl(remotecam,keys[f]);
+		if(f==sizeof(keys)/2)
+		{
+			kill(pids[0],SIGKILL);
+			printf("Killed a worker\n");
+		}
+		if(f==sizeof(keys)*3/4)
+		{
+			kill(pids[1],SIGSTOP);
+			printf("Stopped a worker\n");
+		}
+		qlstep(localcam,(const qltri**)triangles);
+		n=qldistrender(dist,remotecam,(const qltri**)triangles);
+		if(n<0||memcmp(local->data,remote->data,W*H*3)||memcmp(local->z,remote->z,W*H*sizeof(double)))
+		{
+			printf("Frame %d differs!\n",f);
+			fail=1;
+		}
+		if(f%8==0||f==sizeof(keys)/2||f==sizeof(keys)*3/4)
+		{
+			printf("Frame %d, %d workers:",f,n);
+			for(i=0;i<n;i++)printf(" rows %d-%d in %.2fms",dist->band[i],dist->band[i+1],dist->ns[i]/1e6);
+			printf("\n");
+		}
+	}
+	if(dist->n!=WORKERS-2)
+	{
+		printf("%d workers left!\n",dist->n);
+		fail=1;
+	}
+
+	freeqldist(&dist);
+	kill(pids[1],SIGKILL);
+	for(i=0;i<WORKERS;i++)
+	{
+		int status;
+		waitpid(pids[i],&status,0);
+		if(i>1&&(!WIFEXITED(status)||WEXITSTATUS(status)))
+		{
+			printf("Worker %d didn't quit cleanly!\n",i);
+			fail=1;
+		}
+	}
+	freeqlcamera(&localcam);
+	freeqlcamera(&remotecam);
+	freeqlraster(&local);
+	freeqlraster(&remote);
+	remove("build/dist_test.sock");
+
+	if(!badrequest(triangles,QL_RGB24))
+	{
+		printf("A worker didn't answer a valid request!\n");
+		fail=1;
+	}
+	if(badrequest(triangles,7))
+	{
+		printf("A worker answered a request with an unknown pixel format!\n");
+		fail=1;
+	}
+	for(i=0;i<TRIS;i++)free(triangles[i]);
+	if(fail)return -1;
+	printf("Ok.");
+	return 0;
+}
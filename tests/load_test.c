@@ -0,0 +1,90 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../src/quicklight.h"
+#include "../src/qslt.h"
+#include "../src/qlscene.h"
+#include "../src/qlstats.h"
+
+/*
+Time to first frame of a large qlt file, loaded all at once (qltToQltriList) and in the background (Qltload).
+The background loader must end up with the same triangles as qltToQltriList.
+*/
+
+#define TRIS 60000
+#define SIZE 48
+#define FNAME "build/load_test.slt"
+
+/*Renders a frame of a scene: culls it and traces the rest*/
+void frame(qlcamera *cam,const qlscene *scene,const qltri **visible)
+{
+	qlscenecull(scene,cam,visible);
+	qltracerows(cam,visible,0,cam->image->h);
+	qlshade(cam);
+}
+
+int main()
+{
+	int i,len,fail=0,frames=0;
+	unsigned long long t,syncfirst;
+	FILE *f=fopen(FNAME,"w");
+	if(!f)return -1;
+	srand(1);
+	fprintf(f,"#Random triangles\n%d\n",TRIS);
+	for(i=0;i<TRIS;i++)
+	{
+		double x=rand()%200-100,y=rand()%200-100,z=rand()%20;
+		fprintf(f,"%d %d %d\n%g %g %g\n%g %g %g\n%g %g %g\n",rand()%256,rand()%256,rand()%256,
+			x,y,z,x+1+rand()%3,y,z,x,y+1+rand()%3,z+rand()%2);
+	}
+	fclose(f);
+
+	qlraster *raster=Qlraster(SIZE,SIZE,3);
+	qlvect pos={0,-20,10},dir={0,1,-0.3};
+	qlcamera *cam=Qlcamera(raster,&pos,&dir,0,1,1,1,80);
+	const qltri **visible=malloc(sizeof(qltri*)*(TRIS+1));
+
+	/*All at once*/
+	t=qlstatsnow();
+	qltri **triangles=qltToQltriList(FNAME);
+	if(!triangles)return -1;
+	qlscene *scene=Qlscene(triangles);
+	frame(cam,scene,visible);
+	syncfirst=qlstatsnow()-t;
+
+	/*In the background, drawing frames with whatever has arrived*/
+	qltload *load=Qltload(FNAME,2000,NULL,NULL);
+	if(!load)return -1;
+	while(!load->fullframe)
+	{
+		len=qltloadpoll(load);
+		if(!len)continue;
+		frame(cam,&load->scene,visible);
+		frames++;
+		qltloadframe(load);
+	}
+	printf("%d triangles\n",TRIS);
+	printf("qltToQltriList: first frame after %.1fms\n",syncfirst/1e6);
+	printf("Qltload: first batch after %.1fms, first frame after %.1fms, file read after %.1fms, full scene drawn after %.1fms (%d frames)\n",
+		load->firstbatch/1e6,load->firstframe/1e6,load->loaded/1e6,load->fullframe/1e6,frames);
+
+	if(load->scene.len!=TRIS||load->scene.tris[TRIS]!=NULL)fail=1;
+	for(i=0;i<load->scene.len&&!fail;i++)
+		if(memcmp(load->scene.tris[i],triangles[i],sizeof(qltri))||
+			load->scene.radii[i]!=scene->radii[i]||memcmp(&load->scene.centers[i],&scene->centers[i],sizeof(qlvect)))
+		{
+			printf("Triangle %d differs!\n",i);
+			fail=1;
+		}
+
+	freeqltload(&load);
+	freeqlscene(&scene);
+	freeqltriarray(&triangles);
+	free(visible);
+	freeqlcamera(&cam);
+	freeqlraster(&raster);
+	remove(FNAME);
+	if(fail)return -1;
+	printf("Ok.");
+	return 0;
+}
@@ -0,0 +1,134 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "../src/quicklight.h"
+#include "../src/qlvect.h"
+#include "../src/qlscene.h"
+#include "../src/qllod.h"
+
+/*
+Builds levels of detail for a hilly terrain and looks across it from a few places, reporting how many
+triangles are picked with a one pixel error against the ones in view.
+A small scene with cells either side of the origin must build a hierarchy as well.
+One of the views is also drawn: with a zero pixel error the depth must match the full terrain's, and with a one
+pixel error the differences are reported.
+*/
+
+#define GRID 256 /*The terrain has GRID*GRID*2 triangles*/
+#define SPACING 4.0
+#define CELL 64.0
+#define W 48
+#define H 36
+#define DRAWN 3 /*The view that is drawn*/
+
+/*Rolling hills, in a terrain SPACING*GRID units across*/
+double height(int x,int y)
+{
+	return 20+12*sin(x*0.09)*cos(y*0.07)+6*sin(x*0.03+y*0.05)+(rand()%16)/32.0;
+}
+
+int main()
+{
+	int x,y,i,f,n=0,l,fail=0,culled,silhouette;
+	long diff;
+	qltri **triangles=malloc(sizeof(qltri*)*(GRID*GRID*2+1));
+	qlvect *verts=malloc(sizeof(qlvect)*(GRID+1)*(GRID+1));
+	const qltri **visible;
+	const qlvect views[][2]={
+		{{-10,-10,45},{1,1,-0.12}},
+		{{GRID*SPACING/2,-20,40},{0,1,-0.08}},
+		{{GRID*SPACING+10,GRID*SPACING/3,45},{-1,0.4,-0.1}},
+		{{GRID*SPACING/2,GRID*SPACING/2,60},{1,0.2,-0.3}},
+		{{GRID*SPACING/4,GRID*SPACING/4,30},{0.3,1,-0.05}}};
+	srand(1);
+	for(y=0;y<=GRID;y++)
+		for(x=0;x<=GRID;x++)verts[x+y*(GRID+1)]=qlv(x*SPACING,y*SPACING,height(x,y));
+	for(y=0;y<GRID;y++)
+		for(x=0;x<GRID;x++)
+		{
+			i=x+y*(GRID+1);
+			triangles[n]=Qltri(&verts[i],&verts[i+1],&verts[i+GRID+1]);
+			triangles[n]->colour[0]=x*2;
+			triangles[n]->colour[1]=100+y;
+			triangles[n++]->colour[2]=60;
+			triangles[n]=Qltri(&verts[i+1],&verts[i+GRID+2],&verts[i+GRID+1]);
+			triangles[n]->colour[0]=x*2;
+			triangles[n]->colour[1]=90+y;
+			triangles[n++]->colour[2]=40;
+		}
+	triangles[n]=NULL;
+
+	/*Two triangles either side of x=0, in cells -1 and 0*/
+	{
+		qlvect a={-0.4,0,0},b={-0.1,0,0},c={-0.1,0.3,0},d={0.1,0,0},e={0.4,0,0},g={0.1,0.3,0};
+		qltri *small[3]={Qltri(&a,&b,&c),Qltri(&d,&e,&g),NULL};
+		qllodscene *around=Qllodscene((const qltri**)small,0.5);
+		if(!around||around->ncells!=2)
+		{
+			printf("Cells either side of the origin weren't merged!\n");
+			fail=1;
+		}
+		freeqllodscene(&around);
+		free(small[0]);
+		free(small[1]);
+	}
+
+	qllodscene *lods=Qllodscene((const qltri**)triangles,CELL);
+	if(!lods)return -1;
+	printf("%d triangles in %d cells (%d nodes). Levels of the root:",n,lods->ncells,lods->n);
+	for(l=0;l<lods->nodes[lods->root].lod->nlevels;l++)printf(" %d (error %.3f)",lods->nodes[lods->root].lod->levels[l]->ntris,lods->nodes[lods->root].lod->error[l]);
+	printf("\n");
+
+	qlscene *scene=Qlscene(triangles);
+	visible=malloc(sizeof(qltri*)*(n+1));
+	qlraster *full=Qlraster(W,H,3),*lod=Qlraster(W,H,3);
+	qlcamera *fullcam=Qlcamera(full,&views[0][0],&views[0][1],0,1,1,0.75,2000);
+	qlcamera *lodcam=Qlcamera(lod,&views[0][0],&views[0][1],0,1,1,0.75,2000);
+
+	for(f=0;f<sizeof(views)/sizeof(views[0]);f++)
+	{
+		qlcamerastate state;
+		qlgetcamerastate(fullcam,&state);
+		state.pos=views[f][0];
+		state.dir=qlvnormalize(views[f][1]);
+		qlsetcamerastate(fullcam,&state);
+		qlsetcamerastate(lodcam,&state);
+		culled=qlscenecull(scene,fullcam,visible);
+		qllodselect(lods,lodcam,1);
+		printf("View %d: %d triangles in view, %d with a 1 pixel error (%.1fx fewer)\n",f,culled,lods->selected,(double)culled/lods->selected);
+		if(lods->selected>=culled)fail=1;
+		if(f!=DRAWN)continue;
+
+		/*Tracing the whole terrain is slow, so only the view with the fewest triangles in it is drawn*/
+		qltracerows(fullcam,visible,0,H);
+		qltracerows(lodcam,qllodselect(lods,lodcam,0),0,H);
+		if(memcmp(full->z,lod->z,sizeof(double)*W*H))
+		{
+			printf("View %d differs at full detail!\n",f);
+			fail=1;
+		}
+		qltracerows(lodcam,qllodselect(lods,lodcam,1),0,H);
+		for(i=0,silhouette=0,diff=0;i<W*H;i++)
+		{
+			if((full->z[i]<INFINITY)!=(lod->z[i]<INFINITY))silhouette++;
+			for(x=0;x<3;x++)diff+=abs(full->data[i*3+x]-lod->data[i*3+x]);
+		}
+		printf("With a 1 pixel error, %d of %d pixels changed between terrain and sky, mean colour difference %.2f\n",
+			silhouette,W*H,diff/(3.0*W*H));
+	}
+
+	free(visible);
+	freeqlscene(&scene);
+	freeqllodscene(&lods);
+	freeqlcamera(&fullcam);
+	freeqlcamera(&lodcam);
+	freeqlraster(&full);
+	freeqlraster(&lod);
+	for(i=0;i<n;i++)free(triangles[i]);
+	free(triangles);
+	free(verts);
+	if(fail)return -1;
+	printf("Ok.");
+	return 0;
+}
@@ -0,0 +1,278 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "../src/quicklight.h"
+#include "../src/qslt.h"
+#include "../src/qlmesh.h"
+#include "../src/qlstats.h"
+
+/*
+Checks the OBJ and STL importers on small files (polygon fans, negative indices, materials, vertex welding
+and malformed or truncated input), renders a terrain loaded from each format with qlstepmesh against qlstep,
+and compares the memory and load time of the meshes with qltToQltriList.
+*/
+
+#define OBJ "build/mesh_test.obj"
+#define MTL "build/mesh_test.mtl"
+#define STL "build/mesh_test.stl"
+#define SLT "build/mesh_test.slt"
+#define GRID 100 /*The terrain has GRID*GRID*2 triangles*/
+#define W 24
+#define H 18
+
+int fail=0;
+
+void check(int ok,const char *what)
+{
+	if(ok)return;
+	printf("%s!\n",what);
+	fail=1;
+}
+
+void put32(FILE *f,unsigned int v)
+{
+	unsigned char p[4]={v,v>>8,v>>16,v>>24};
+	fwrite(p,1,4,f);
+}
+
+void putfloat(FILE *f,float v)
+{
+	unsigned int u;
+	memcpy(&u,&v,4);
+	put32(f,u);
+}
+
+/*Writes a binary STL triangle with the given attribute bytes*/
+void stltri(FILE *f,qlvect a,qlvect b,qlvect c,unsigned int attr)
+{
+	int i;
+	qlvect *v[3]={&a,&b,&c};
+	for(i=0;i<3;i++)putfloat(f,0);
+	for(i=0;i<3;i++)
+	{
+		putfloat(f,v[i]->x);
+		putfloat(f,v[i]->y);
+		putfloat(f,v[i]->z);
+	}
+	fputc(attr&255,f);
+	fputc(attr>>8,f);
+}
+
+/*Whether the t-th triangle of a mesh has vertices a, b and c and the given colour*/
+int meshtri(const qlmesh *m,int t,int a,int b,int c,int r,int g,int bl)
+{
+	const unsigned char *col=m->colours+t*3;
+	return t<m->ntris&&m->idx[t*3]==(unsigned)a&&m->idx[t*3+1]==(unsigned)b&&m->idx[t*3+2]==(unsigned)c&&col[0]==r&&col[1]==g&&col[2]==bl;
+}
+
+void smallobj(void)
+{
+	FILE *f=fopen(MTL,"w");
+	fprintf(f,"# Two materials\nnewmtl red\nKd 1 0 0\nnewmtl half\n\tKd 0.5 1.5 -1\n");
+	fclose(f);
+	f=fopen(OBJ,"w");
+	fprintf(f,"# A quad, a pentagon and a triangle\nmtllib mesh_test.mtl\n");
+	fprintf(f,"v 0 0 0\nv 1 0 0\nv 1 1 0\nv 0 1 0\n");
+	fprintf(f,"vt 0 0\nvn 0 0 1\n");
+	fprintf(f,"usemtl red\nf 1/1 2/1 3/1 4/1\n");
+	fprintf(f,"v 0 0 1\nv 1 0 1\nv 2 1 1\nv 1 2 1\nv 0 1 1\n");
+	fprintf(f,"usemtl half\n  f -5//1 -4//1 -3//1 -2//1 -1//1\n");
+	fprintf(f,"usemtl missing\nf 1/1/1 6/1/1 9/1/1\n");
+	/*A corner out of range ends the polygon: only 1 2 5 is kept*/
+	fprintf(f,"f 1 2 5 42 3\n");
+	/*Too few corners, and lines that aren't understood*/
+	fprintf(f,"f 1 2\nf\ng group\ns off\nv 1 2\n");
+	fclose(f);
+
+	qlmesh *m=qlobjToQlmesh(OBJ);
+	check(m!=NULL,"The OBJ file didn't load");
+	if(!m)return;
+	check(m->nverts==10,"Wrong number of OBJ vertices");
+	check(m->ntris==2+3+1+1,"Wrong number of OBJ triangles");
+	check(meshtri(m,0,0,1,2,255,0,0)&&meshtri(m,1,0,2,3,255,0,0),"The quad isn't a fan with the red material");
+	check(meshtri(m,2,4,5,6,127,255,0)&&meshtri(m,3,4,6,7,127,255,0)&&meshtri(m,4,4,7,8,127,255,0),
+		"The pentagon isn't a fan of its negative indices with the clamped Kd");
+	check(meshtri(m,5,0,5,8,qlmeshcolour[0],qlmeshcolour[1],qlmeshcolour[2]),"An unknown material isn't the default colour");
+	check(meshtri(m,6,0,1,4,qlmeshcolour[0],qlmeshcolour[1],qlmeshcolour[2]),"A corner out of range isn't skipped");
+	check(m->verts[9].x==1&&m->verts[9].y==2&&m->verts[9].z==0,"A short vertex isn't padded with zeros");
+	freeqlmesh(&m);
+
+	/*Without its .mtl, every triangle has the default colour*/
+	remove(MTL);
+	m=qlobjToQlmesh(OBJ);
+	check(m&&m->ntris==7&&meshtri(m,0,0,1,2,qlmeshcolour[0],qlmeshcolour[1],qlmeshcolour[2]),"A missing .mtl isn't ignored");
+	freeqlmesh(&m);
+	check(!qlobjToQlmesh("build/mesh_test_missing.obj"),"A missing OBJ file loaded");
+	remove(OBJ);
+}
+
+void smallstl(void)
+{
+	/*A cube: 12 triangles over 8 vertices, each face with its own attribute*/
+	const int faces[6][4]={{0,1,3,2},{4,6,7,5},{0,4,5,1},{2,3,7,6},{0,2,6,4},{1,5,7,3}};
+	qlvect corner[8];
+	int i;
+	FILE *f;
+	unsigned char header[80]={0};
+	for(i=0;i<8;i++)corner[i]=(qlvect){i&1,(i>>1)&1,(i>>2)&1};
+	f=fopen(STL,"wb");
+	fwrite(header,1,80,f);
+	put32(f,12);
+	for(i=0;i<6;i++)
+	{
+		/*VisCAM colours (5 bits per channel, blue lowest); the last face has none*/
+		unsigned int attr=i<5?(31<<(i%3*5)):0x8000|31;
+		stltri(f,corner[faces[i][0]],corner[faces[i][1]],corner[faces[i][2]],attr);
+		stltri(f,corner[faces[i][0]],corner[faces[i][2]],corner[faces[i][3]],attr);
+	}
+	fclose(f);
+	qlmesh *m=qlstlToQlmesh(STL);
+	check(m!=NULL,"The STL file didn't load");
+	if(!m)return;
+	check(m->nverts==8,"STL vertices weren't welded");
+	check(m->ntris==12,"Wrong number of STL triangles");
+	for(i=0;i<12&&m->ntris==12;i++)
+	{
+		const qlvect *a=&m->verts[m->idx[i*3]],*c=&m->verts[m->idx[i*3+2]];
+		const int *face=faces[i/2];
+		check(!memcmp(a,&corner[face[0]],sizeof(qlvect))&&!memcmp(c,&corner[face[i%2?3:2]],sizeof(qlvect)),"An STL triangle has the wrong vertices");
+	}
+	check(meshtri(m,0,m->idx[0],m->idx[1],m->idx[2],0,0,255)&&meshtri(m,2,m->idx[6],m->idx[7],m->idx[8],0,255,0)&&
+		meshtri(m,4,m->idx[12],m->idx[13],m->idx[14],255,0,0),"Wrong STL colours");
+	check(meshtri(m,10,m->idx[30],m->idx[31],m->idx[32],qlmeshcolour[0],qlmeshcolour[1],qlmeshcolour[2]),"A triangle without colour isn't the default colour");
+	freeqlmesh(&m);
+
+	/*Truncated: the triangle count doesn't match the size*/
+	check(!truncate(STL,84+50*11+20),"Couldn't truncate the STL file");
+	check(!qlstlToQlmesh(STL),"A truncated STL file loaded");
+	f=fopen(STL,"w");
+	fprintf(f,"solid cube\nfacet normal 0 0 1\nouter loop\nvertex 0 0 0\nvertex 1 0 0\nvertex 0 1 0\nendloop\nendfacet\nendsolid cube\n");
+	fclose(f);
+	check(!qlstlToQlmesh(STL),"An ASCII STL file loaded");
+	f=fopen(STL,"w");
+	fprintf(f,"solid");
+	fclose(f);
+	check(!qlstlToQlmesh(STL),"A file shorter than the STL header loaded");
+	remove(STL);
+}
+
+/*Bytes taken by a triangle list and by a mesh (not counting allocator overhead)*/
+size_t listbytes(int n)
+{
+	return (sizeof(qltri)+sizeof(qltri*))*n+sizeof(qltri*);
+}
+
+size_t meshbytes(const qlmesh *m)
+{
+	return sizeof(qlmesh)+sizeof(qlvect)*m->vcap+(sizeof(unsigned int)*3+3)*m->tcap;
+}
+
+/*Renders a mesh with qlstepmesh and its triangles with qlstep, which must come out the same*/
+void render(const qlmesh *m,const char *name)
+{
+	int i;
+	qltri **tris=malloc(sizeof(qltri*)*(m->ntris+1));
+	qlraster *a=Qlraster(W,H,3),*b=Qlraster(W,H,3);
+	qlvect pos={-5,-5,12},dir={1,1,-0.6};
+	qlcamera *ca=Qlcamera(a,&pos,&dir,0,1,1,0.75,3*GRID),*cb=Qlcamera(b,&pos,&dir,0,1,1,0.75,3*GRID);
+	for(i=0;i<m->ntris;i++)
+	{
+		tris[i]=Qltri(&m->verts[m->idx[i*3]],&m->verts[m->idx[i*3+1]],&m->verts[m->idx[i*3+2]]);
+		memcpy(tris[i]->colour,m->colours+i*3,3);
+	}
+	tris[m->ntris]=NULL;
+	qlstepmesh(ca,m);
+	qlstep(cb,(const qltri**)tris);
+	if(memcmp(a->data,b->data,W*H*3)||memcmp(a->z,b->z,sizeof(double)*W*H))
+	{
+		printf("The %s mesh renders differently from its triangles!\n",name);
+		fail=1;
+	}
+	freeqltriarray(&tris);
+	freeqlcamera(&ca);
+	freeqlcamera(&cb);
+	freeqlraster(&a);
+	freeqlraster(&b);
+}
+
+void terrain(void)
+{
+	int x,y,i,n=GRID*GRID*2;
+	unsigned long long t;
+	float *z=malloc(sizeof(float)*(GRID+1)*(GRID+1));
+	FILE *slt=fopen(SLT,"w"),*obj=fopen(OBJ,"w"),*stl=fopen(STL,"wb"),*mtl=fopen(MTL,"w");
+	unsigned char header[80]={0};
+	/*Heights that are exact in single precision, so that every format holds the same terrain*/
+	srand(1);
+	for(i=0;i<(GRID+1)*(GRID+1);i++)z[i]=(rand()%64)/32.0;
+	fprintf(slt,"#Terrain\n%d\n",n);
+	fprintf(obj,"mtllib mesh_test.mtl\n");
+	fprintf(mtl,"newmtl a\nKd 0 0.4 1\nnewmtl b\nKd 1 0.4 0\n");
+	fwrite(header,1,80,stl);
+	put32(stl,n);
+	for(y=0;y<=GRID;y++)
+		for(x=0;x<=GRID;x++)fprintf(obj,"v %d %d %g\n",x,y,z[x+y*(GRID+1)]);
+	for(y=0;y<GRID;y++)
+		for(x=0;x<GRID;x++)
+		{
+			qlvect a={x,y,z[x+y*(GRID+1)]},b={x+1,y,z[x+1+y*(GRID+1)]},c={x,y+1,z[x+(y+1)*(GRID+1)]},d={x+1,y+1,z[x+1+(y+1)*(GRID+1)]};
+			i=x+y*(GRID+1)+1;
+			fprintf(slt,"0 102 255\n%d %d %g\n%d %d %g\n%d %d %g\n",x,y,a.z,x+1,y,b.z,x,y+1,c.z);
+			fprintf(slt,"255 102 0\n%d %d %g\n%d %d %g\n%d %d %g\n",x+1,y,b.z,x+1,y+1,d.z,x,y+1,c.z);
+			fprintf(obj,"usemtl a\nf %d %d %d\nusemtl b\nf %d %d %d\n",i,i+1,i+GRID+1,i+1,i+GRID+2,i+GRID+1);
+			stltri(stl,a,b,c,(31<<0)|(12<<5));
+			stltri(stl,b,d,c,(31<<10)|(12<<5));
+		}
+	fclose(slt);
+	fclose(obj);
+	fclose(stl);
+	fclose(mtl);
+	free(z);
+
+	t=qlstatsnow();
+	qltri **tris=qltToQltriList(SLT);
+	t=qlstatsnow()-t;
+	check(tris&&qllen((void**)tris)==n,"The .slt terrain didn't load");
+	printf("%d triangles\n",n);
+	printf("qltToQltriList: %zu bytes, %.1fms\n",listbytes(n),t/1e6);
+	freeqltriarray(&tris);
+
+	t=qlstatsnow();
+	qlmesh *m=qlobjToQlmesh(OBJ);
+	t=qlstatsnow()-t;
+	check(m&&m->nverts==(GRID+1)*(GRID+1)&&m->ntris==n,"The OBJ terrain didn't load");
+	if(m)
+	{
+		printf("qlobjToQlmesh: %zu bytes (%.1fx less), %.1fms\n",meshbytes(m),(double)listbytes(n)/meshbytes(m),t/1e6);
+		check(m->colours[0]==0&&m->colours[1]==102&&m->colours[2]==255&&m->colours[3]==255,"Wrong OBJ terrain colours");
+		render(m,"OBJ");
+	}
+	freeqlmesh(&m);
+
+	t=qlstatsnow();
+	m=qlstlToQlmesh(STL);
+	t=qlstatsnow()-t;
+	check(m&&m->nverts==(GRID+1)*(GRID+1)&&m->ntris==n,"The STL terrain didn't load or wasn't welded");
+	if(m)
+	{
+		printf("qlstlToQlmesh: %zu bytes (%.1fx less), %.1fms\n",meshbytes(m),(double)listbytes(n)/meshbytes(m),t/1e6);
+		check(m->colours[0]==0&&m->colours[1]==98&&m->colours[2]==255&&m->colours[3]==255,"Wrong STL terrain colours");
+		render(m,"STL");
+	}
+	freeqlmesh(&m);
+	remove(SLT);
+	remove(OBJ);
+	remove(MTL);
+	remove(STL);
+}
+
+int main()
+{
+	smallobj();
+	smallstl();
+	terrain();
+	if(fail)return -1;
+	printf("Ok.");
+	return 0;
+}
@@ -0,0 +1,103 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../src/quicklight.h"
+#include "../src/qlscene.h"
+#include "../src/qlocclusion.h"
+
+/*
+Walks through a grid of rooms (walls with doorways, and small clutter triangles all over),
+turning and moving in bursts, with and without occlusion culling.
+Every frame must come out the same both ways, and the culled/tested ratio is printed.
+*/
+
+#define ROOMS 6
+#define ROOM 10.0
+#define CLUTTER 3000
+#define W 64
+#define H 48
+
+qltri *triangles[ROOMS*(ROOMS+1)*8+CLUTTER+1];
+int ntriangles=0;
+
+void addtri(qlvect a,qlvect b,qlvect c,int colour)
+{
+	triangles[ntriangles]=Qltri(&a,&b,&c);
+	triangles[ntriangles]->colour[0]=colour;
+	triangles[ntriangles]->colour[1]=colour*3;
+	triangles[ntriangles]->colour[2]=colour*7;
+	ntriangles++;
+}
+
+/*A wall from (x0,y0) to (x1,y1), 3 units high*/
+void addwall(double x0,double y0,double x1,double y1,int colour)
+{
+	addtri((qlvect){x0,y0,0},(qlvect){x1,y1,0},(qlvect){x1,y1,3},colour);
+	addtri((qlvect){x0,y0,0},(qlvect){x1,y1,3},(qlvect){x0,y0,3},colour+1);
+}
+
+int main()
+{
+	int i,j,f,k,fail=0;
+	unsigned long long tested=0,culled=0;
+	const char keys[]="wwwwwwwwddddaaaaeeeeeeeeeeeeewwwwwqqqqqqqqqqqqqqqqqqqqsssssssswwwwwwwwwwrrffggttzzxx";
+	srand(3);
+	for(i=0;i<=ROOMS;i++)
+		for(j=0;j<ROOMS;j++)
+		{
+			addwall(i*ROOM,j*ROOM,i*ROOM,j*ROOM+4,i*7+j);
+			addwall(i*ROOM,j*ROOM+6,i*ROOM,j*ROOM+ROOM,i*7+j+2);
+			addwall(j*ROOM,i*ROOM,j*ROOM+4,i*ROOM,i*5+j);
+			addwall(j*ROOM+6,i*ROOM,j*ROOM+ROOM,i*ROOM,i*5+j+2);
+		}
+	for(i=0;i<CLUTTER;i++)
+	{
+		qlvect a={(rand()%(int)(ROOMS*ROOM*10))/10.0,(rand()%(int)(ROOMS*ROOM*10))/10.0,(rand()%30)/10.0};
+		addtri(a,(qlvect){a.x+0.3,a.y,a.z},(qlvect){a.x,a.y+0.3,a.z+0.3},i);
+	}
+	triangles[ntriangles]=NULL;
+
+	qlscene *scene=Qlscene(triangles);
+	qlraster *plain=Qlraster(W,H,3),*culling=Qlraster(W,H,3);
+	qlvect pos={15,15,1.5},dir={1,0.3,0};
+	qlcamera *plaincam=Qlcamera(plain,&pos,&dir,0,1,1,0.75,200);
+	qlcamera *cullingcam=Qlcamera(culling,&pos,&dir,0,1,1,0.75,200);
+	qlocclusion *occ=Qlocclusion(cullingcam);
+	const qltri **visible=malloc(sizeof(qltri*)*(ntriangles+1));
+
+	for(f=0;keys[f];f++)
+	{
+		/*Every few frames the camera jumps or turns much farther than usual*/
+		for(k=0;k<(f%7==3?6:1);k++)
+		{
+			qlcameractl(plaincam,keys[f]);
+			qlcameractl(cullingcam,keys[f]);
+		}
+		qlscenecull(scene,plaincam,visible);
+		qltracerows(plaincam,visible,0,H);
+		qlscenecull(scene,cullingcam,visible);
+		qlocclusioncull(occ,cullingcam,visible);
+		qltracerows(cullingcam,visible,0,H);
+		qlocclusionstore(occ,cullingcam);
+		tested+=occ->tested;
+		culled+=occ->culled;
+		if(memcmp(plain->data,culling->data,W*H*3)||memcmp(plain->z,culling->z,W*H*sizeof(double)))
+		{
+			printf("Frame %d differs!\n",f);
+			fail=1;
+		}
+	}
+	printf("%d frames, %llu triangles tested, %llu culled (%.1f%%)\n",f,tested,culled,tested?100.0*culled/tested:0);
+
+	free(visible);
+	freeqlocclusion(&occ);
+	freeqlcamera(&plaincam);
+	freeqlcamera(&cullingcam);
+	freeqlraster(&plain);
+	freeqlraster(&culling);
+	freeqlscene(&scene);
+	for(i=0;i<ntriangles;i++)free(triangles[i]);
+	if(fail)return -1;
+	printf("Ok.");
+	return 0;
+}
@@ -0,0 +1,161 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#include "../src/quicklight.h"
+#include "../src/qlmesh.h"
+#include "../src/qlstats.h"
+
+/*
+Compares the pixel traversal orders (QL_ORDER_*) of the trace stage.
+Renders a procedural terrain (as a triangle list and as an indexed mesh) with each order,
+and reports rays per second and cache misses per ray.
+Cache misses are read with perf_event_open, and reported as n/a where the kernel doesn't allow it
+(see /proc/sys/kernel/perf_event_paranoid).
+Build with optimizations for meaningful numbers: QLFLAGS=-O2 source buildtests.sh
+*/
+
+#define GRID 40 /*The terrain has GRID*GRID*2 triangles*/
+#define W 128
+#define H 96
+#define FRAMES 2
+
+typedef struct _order{
+	const char *name;
+	char order;
+	int tile;
+} order;
+
+/*Opens a counter for the calling process, or returns -1*/
+int perfopen(unsigned int type,unsigned long long config)
+{
+	struct perf_event_attr attr;
+	memset(&attr,0,sizeof(attr));
+	attr.size=sizeof(attr);
+	attr.type=type;
+	attr.config=config;
+	attr.disabled=1;
+	attr.exclude_kernel=1;
+	attr.exclude_hv=1;
+	return syscall(SYS_perf_event_open,&attr,0,-1,-1,0);
+}
+
+long long perfread(int fd)
+{
+	long long n;
+	if(fd<0||read(fd,&n,sizeof(n))!=sizeof(n))return -1;
+	return n;
+}
+
+void perfstart(int fd)
+{
+	if(fd<0)return;
+	ioctl(fd,PERF_EVENT_IOC_RESET,0);
+	ioctl(fd,PERF_EVENT_IOC_ENABLE,0);
+}
+
+void perfstop(int fd)
+{
+	if(fd>=0)ioctl(fd,PERF_EVENT_IOC_DISABLE,0);
+}
+
+void report(const char *scene,const order *o,unsigned long long ns,long long misses,long long l1misses)
+{
+	double rays=(double)FRAMES*W*H;
+	printf("%-6s %-10s %10.0f rays/s",scene,o->name,rays*1e9/ns);
+	if(misses>=0)printf(" %8.3f LLC misses/ray",misses/rays);
+	else printf("          n/a LLC misses/ray");
+	if(l1misses>=0)printf(" %8.3f L1d misses/ray\n",l1misses/rays);
+	else printf("          n/a L1d misses/ray\n");
+}
+
+int main()
+{
+	const order orders[]={
+		{"rows",QL_ORDER_ROWS,0},
+		{"tiles8",QL_ORDER_TILES,8},
+		{"tiles16",QL_ORDER_TILES,16},
+		{"tiles32",QL_ORDER_TILES,32},
+		{"morton8",QL_ORDER_MORTON,8},
+		{"morton16",QL_ORDER_MORTON,16},
+		{"morton32",QL_ORDER_MORTON,32},
+	};
+	int norders=sizeof(orders)/sizeof(order);
+	int i,x,y,f,o,llc,l1;
+	unsigned long long t;
+	qlmesh *mesh=Qlmesh((GRID+1)*(GRID+1),GRID*GRID*2);
+	unsigned char colour[3];
+	qltri **triangles;
+	qlraster *raster=Qlraster(W,H,3);
+	qlvect pos={-GRID/2.0,-GRID/2.0,8},dir={1,1,-0.4};
+	qlcamera *cam=Qlcamera(raster,&pos,&dir,0,1,1,0.75,4*GRID);
+
+	/*A bumpy terrain, so that rays hit triangles all over the list*/
+	srand(1);
+	for(y=0;y<=GRID;y++)
+		for(x=0;x<=GRID;x++)
+		{
+			qlvect v={x,y,(rand()%100)/50.0};
+			qlmeshvert(mesh,&v);
+		}
+	for(y=0;y<GRID;y++)
+		for(x=0;x<GRID;x++)
+		{
+			i=x+y*(GRID+1);
+			colour[0]=x*6;
+			colour[1]=y*6;
+			colour[2]=128;
+			qlmeshtri(mesh,i,i+1,i+GRID+1,colour);
+			colour[2]=64;
+			qlmeshtri(mesh,i+1,i+GRID+2,i+GRID+1,colour);
+		}
+	triangles=malloc(sizeof(qltri*)*(mesh->ntris+1));
+	for(i=0;i<mesh->ntris;i++)
+	{
+		triangles[i]=Qltri(&mesh->verts[mesh->idx[i*3]],&mesh->verts[mesh->idx[i*3+1]],&mesh->verts[mesh->idx[i*3+2]]);
+		memcpy(triangles[i]->colour,&mesh->colours[i*3],3);
+	}
+	triangles[mesh->ntris]=NULL;
+
+	llc=perfopen(PERF_TYPE_HARDWARE,PERF_COUNT_HW_CACHE_MISSES);
+	l1=perfopen(PERF_TYPE_HW_CACHE,PERF_COUNT_HW_CACHE_L1D|(PERF_COUNT_HW_CACHE_OP_READ<<8)|(PERF_COUNT_HW_CACHE_RESULT_MISS<<16));
+	printf("%d triangles, %dx%d rays, %d frames per order\n",mesh->ntris,W,H,FRAMES);
+
+	for(o=0;o<norders;o++)
+	{
+		qlcamerasetorder(cam,orders[o].order,orders[o].tile);
+		perfstart(llc);
+		perfstart(l1);
+		t=qlstatsnow();
+		for(f=0;f<FRAMES;f++)qlstep(cam,(const qltri**)triangles);
+		t=qlstatsnow()-t;
+		perfstop(llc);
+		perfstop(l1);
+		report("list",&orders[o],t,perfread(llc),perfread(l1));
+	}
+	for(o=0;o<norders;o++)
+	{
+		qlcamerasetorder(cam,orders[o].order,orders[o].tile);
+		perfstart(llc);
+		perfstart(l1);
+		t=qlstatsnow();
+		for(f=0;f<FRAMES;f++)qlstepmesh(cam,mesh);
+		t=qlstatsnow()-t;
+		perfstop(llc);
+		perfstop(l1);
+		report("mesh",&orders[o],t,perfread(llc),perfread(l1));
+	}
+
+	if(llc>=0)close(llc);
+	if(l1>=0)close(l1);
+	for(i=0;i<mesh->ntris;i++)free(triangles[i]);
+	free(triangles);
+	freeqlmesh(&mesh);
+	freeqlcamera(&cam);
+	freeqlraster(&raster);
+	printf("Ok.");
+	return 0;
+}
@@ -0,0 +1,186 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "../src/quicklight.h"
+#include "../src/qlpost.h"
+#include "../src/qlstats.h"
+
+/*
+Checks the post-processing stage against a per-pixel reference of its nearest and bilinear upscaling and
+of its noise, in both packed formats and from both kinds of rasters, and checks that the noise doesn't
+depend on the number of threads. Then times a large scale factor against the per-pixel floor(x/s) and
+rand() upscale screens used before qlpost.
+Build with optimizations for meaningful timings: QLFLAGS=-O2 source buildtests.sh
+*/
+
+#define W 37
+#define H 23
+#define BENCHW 160
+#define BENCHH 120
+#define BENCHSCALE 8
+#define FRAMES 5
+
+/*Output pixel of the reference*/
+unsigned int pack(const unsigned char *rgb,int fmt)
+{
+	return fmt==QL_XRGB32?(rgb[0]<<16)|(rgb[1]<<8)|rgb[2]:(rgb[2]<<16)|(rgb[1]<<8)|rgb[0];
+}
+
+/*Source coordinate left of the centre of output pixel o, and the weight (0-255) of the next one*/
+void sample(int o,int scale,int len,int *i,int *f)
+{
+	double c=(o+0.5)/scale-0.5;
+	if(c<0)c=0;
+	*i=c;
+	*f=(int)(c*256)&255;
+	if(*i>=len-1)
+	{
+		*i=len-1;
+		*f=0;
+	}
+}
+
+/*Blends a channel of pixels a and b with weight f for b*/
+int blend(int a,int b,int f)
+{
+	return (a*(256-f)+b*f)>>8;
+}
+
+/*Reference upscale of one output pixel, one channel at a time*/
+unsigned int reference(const qlraster *src,int x,int y,int scale,int filter,int fmt,unsigned char noise,unsigned int frame,int stride)
+{
+	unsigned char p[4][3],rgb[3];
+	int i,j,fx,fy,k,n;
+	if(filter==QL_POST_NEAREST)qlgetpixel(src,x/scale+(y/scale)*src->w,rgb);
+	else
+	{
+		sample(x,scale,src->w,&i,&fx);
+		sample(y,scale,src->h,&j,&fy);
+		qlgetpixel(src,i+j*src->w,p[0]);
+		qlgetpixel(src,(i+1<src->w?i+1:i)+j*src->w,p[1]);
+		qlgetpixel(src,i+(j+1<src->h?j+1:j)*src->w,p[2]);
+		qlgetpixel(src,(i+1<src->w?i+1:i)+(j+1<src->h?j+1:j)*src->w,p[3]);
+		for(k=0;k<3;k++)rgb[k]=blend(blend(p[0][k],p[1][k],fx),blend(p[2][k],p[3][k],fx),fy);
+	}
+	if(noise)
+	{
+		n=256-(((qlposthash(qlposthash(frame)^(x+y*stride))&255)*noise)>>8);
+		for(k=0;k<3;k++)rgb[k]=(rgb[k]*n)>>8;
+	}
+	return pack(rgb,fmt);
+}
+
+/*The upscale screens did before qlpost: floor(x/s) and a floating-point rand() factor for every output pixel*/
+void oldupscale(const qlraster *src,unsigned int *dst,int scale,unsigned char rnd)
+{
+	int x,y,xsize=src->w*scale,ysize=src->h*scale,xlen=src->w;
+	unsigned char rgb[3];
+	double rn=1;
+	for(x=0;x<xsize;x++)
+		for(y=0;y<ysize;y++)
+		{
+			if(rnd)rn=1-(((rand()%256)/255.0)*rnd)/255.0;
+			qlgetpixel(src,floor(x/scale)+floor(y/scale)*xlen,rgb);
+			dst[x+y*xsize]=((int)(rgb[0]*rn)<<16)|((int)(rgb[1]*rn)<<8)|(int)(rgb[2]*rn);
+		}
+}
+
+int main()
+{
+	const int scales[]={1,2,3,5,8};
+	const char *filters[]={"nearest","bilinear"};
+	int i,s,filter,fmt,srcfmt,x,y,threads,fail=0,stride;
+	unsigned int *out,*one,*many;
+	unsigned long long t,old,post[2];
+	qlraster *src[3];
+	qlpost *p=Qlpost(3);
+
+	/*The same random picture in every source format*/
+	srand(1);
+	for(srcfmt=0;srcfmt<3;srcfmt++)src[srcfmt]=Qlraster(W,H,3);
+	for(srcfmt=1;srcfmt<3;srcfmt++)qlrastersetformat(src[srcfmt],srcfmt);
+	for(i=0;i<W*H;i++)
+	{
+		unsigned char r=rand(),g=rand(),b=rand();
+		for(srcfmt=0;srcfmt<3;srcfmt++)qlputpixel(src[srcfmt],i,r,g,b);
+	}
+
+	/*Rows are padded, as a window's XImage may be*/
+	out=malloc(sizeof(unsigned int)*(W*8+3)*H*8);
+	for(s=0;s<5;s++)
+	for(filter=0;filter<2;filter++)
+	for(fmt=QL_XRGB32;fmt<=QL_XBGR32;fmt++)
+	for(srcfmt=0;srcfmt<3;srcfmt++)
+	for(i=0;i<2;i++)
+	{
+		p->filter=filter;
+		p->noise=i?90:0;
+		stride=W*scales[s]+3;
+		qlpostrun(p,src[srcfmt],out,stride,scales[s],fmt);
+		for(y=0;y<H*scales[s];y++)
+			for(x=0;x<W*scales[s];x++)
+				if(out[x+y*stride]!=reference(src[srcfmt],x,y,scales[s],filter,fmt,p->noise,p->frame,stride))
+				{
+					printf("%s, scale %d, format %d from %d, noise %d: pixel (%d,%d) differs!\n",filters[filter],scales[s],fmt,srcfmt,p->noise,x,y);
+					fail=1;
+					x=W*scales[s];
+					y=H*scales[s];
+				}
+	}
+	freeqlpost(&p);
+
+	/*The noise only depends on the frame and the pixel, whichever thread draws it*/
+	one=malloc(sizeof(unsigned int)*W*H*25);
+	many=malloc(sizeof(unsigned int)*W*H*25);
+	for(filter=0;filter<2;filter++)
+		for(threads=2;threads<=8;threads*=2)
+		{
+			qlpost *a=Qlpost(1),*b=Qlpost(threads);
+			a->filter=b->filter=filter;
+			a->noise=b->noise=200;
+			for(i=0;i<3;i++)
+			{
+				qlpostrun(a,src[0],one,W*5,5,QL_XRGB32);
+				qlpostrun(b,src[0],many,W*5,5,QL_XRGB32);
+				if(memcmp(one,many,sizeof(unsigned int)*W*H*25))
+				{
+					printf("%s noise differs with %d threads!\n",filters[filter],threads);
+					fail=1;
+				}
+			}
+			freeqlpost(&a);
+			freeqlpost(&b);
+		}
+	free(one);
+	free(many);
+	free(out);
+	for(srcfmt=0;srcfmt<3;srcfmt++)freeqlraster(&src[srcfmt]);
+
+	/*A large scale factor, with noise*/
+	qlraster *big=Qlraster(BENCHW,BENCHH,4);
+	for(i=0;i<BENCHW*BENCHH;i++)qlputpixel(big,i,rand(),rand(),rand());
+	out=malloc(sizeof(unsigned int)*BENCHW*BENCHH*BENCHSCALE*BENCHSCALE);
+	t=qlstatsnow();
+	for(i=0;i<FRAMES;i++)oldupscale(big,out,BENCHSCALE,90);
+	old=qlstatsnow()-t;
+	p=Qlpost(0);
+	p->noise=90;
+	for(filter=0;filter<2;filter++)
+	{
+		p->filter=filter;
+		t=qlstatsnow();
+		for(i=0;i<FRAMES;i++)qlpostrun(p,big,out,BENCHW*BENCHSCALE,BENCHSCALE,QL_XRGB32);
+		post[filter]=qlstatsnow()-t;
+	}
+	printf("%dx%d upscaled %d-fold with noise:\n",BENCHW,BENCHH,BENCHSCALE);
+	printf("floor/rand: %.2fms per frame\n",old/1e6/FRAMES);
+	for(filter=0;filter<2;filter++)
+		printf("qlpost %-8s %.2fms per frame (%.1fx faster)\n",filters[filter],post[filter]/1e6/FRAMES,(double)old/post[filter]);
+	freeqlpost(&p);
+	freeqlraster(&big);
+	free(out);
+	if(fail)return -1;
+	printf("Ok.");
+	return 0;
+}
@@ -0,0 +1,166 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../src/quicklight.h"
+#include "../src/qslt.h"
+#include "../src/qlscene.h"
+#include "../src/qlreplay.h"
+
+/*
+Records a flythrough over a terrain, then replays it headlessly: from the events, from the camera states,
+and from the events again with scene culling and another traversal order. Every replayed frame must match the
+recorded checksum, and the frame times of each replay are summarized.
+Given a trace and an .slt file (e.g. a session recorded with slt_test), replays that instead:
+    replay_test.c.out session.qlt build/polgono.slt
+*/
+
+#define GRID 12 /*The terrain has GRID*GRID*2 triangles*/
+#define W 40
+#define H 30
+#define FNAME "build/replay_test.qlt"
+
+int compare(const void *a,const void *b)
+{
+	unsigned long long x=*(const unsigned long long*)a,y=*(const unsigned long long*)b;
+	return x<y?-1:x>y;
+}
+
+/*Prints the frame times of the last replay*/
+void report(const char *name,const qlreplay *replay)
+{
+	int i;
+	unsigned long long total=0,*ns=malloc(sizeof(unsigned long long)*replay->n);
+	for(i=0;i<replay->n;i++)total+=ns[i]=replay->frames[i].ns;
+	qsort(ns,replay->n,sizeof(unsigned long long),compare);
+	printf("%-16s %d frames in %.1fms: mean %.2fms, median %.2fms, 95th percentile %.2fms, worst %.2fms, %d mismatches\n",
+		name,replay->n,total/1e6,total/1e6/replay->n,ns[replay->n/2]/1e6,ns[replay->n*95/100]/1e6,ns[replay->n-1]/1e6,replay->mismatches);
+	free(ns);
+}
+
+/*Replays a whole session, tracing every frame with or without culling*/
+void run(qlreplay *replay,qlcamera *cam,char mode,qltri **triangles,const qlscene *scene,const qltri **visible)
+{
+	qlreplaystart(replay,cam,mode);
+	while(qlreplaynext(replay,cam)>=0)
+	{
+		if(scene)
+		{
+			qlscenecull(scene,cam,visible);
+			qlstep(cam,visible);
+		}
+		else qlstep(cam,(const qltri**)triangles);
+		qlreplaydone(replay,cam);
+	}
+}
+
+int main(int argc,char **argv)
+{
+	int x,y,i,n,fail=0;
+	qltri **triangles;
+	const char *keys[]={"w","w","ww","q","q","","wwe","e","e","r","ww","www","f","f","ddd","a","zz","x","w","w","tt","g","g","ss","w"};
+	qlvect pos={-5,-5,5},dir={1,1,-0.4};
+	qlraster *raster;
+	qlcamera *cam;
+	qlreplay *replay;
+
+	if(argc==3)
+	{
+		/*Replays a recorded session over a scene, as it was recorded*/
+		replay=Qlreplay(argv[1]);
+		triangles=qltToQltriList(argv[2]);
+		if(!replay||!triangles)
+		{
+			printf("Couldn't read %s or %s!\n",argv[1],argv[2]);
+			return -1;
+		}
+		raster=Qlraster(replay->w,replay->h,3);
+		qlrastersetformat(raster,replay->fmt);
+		cam=Qlcamera(raster,&pos,&dir,0,1,1,1,1);
+		run(replay,cam,QL_REPLAY_EVENTS,triangles,NULL,NULL);
+		report("events",replay);
+		run(replay,cam,QL_REPLAY_STATES,triangles,NULL,NULL);
+		report("states",replay);
+		freeqlreplay(&replay);
+		freeqlcamera(&cam);
+		freeqlraster(&raster);
+		freeqltriarray(&triangles);
+		printf("Ok.");
+		return 0;
+	}
+
+	/*A bumpy terrain*/
+	srand(1);
+	triangles=malloc(sizeof(qltri*)*(GRID*GRID*2+1));
+	for(y=0,n=0;y<GRID;y++)
+		for(x=0;x<GRID;x++)
+		{
+			qlvect a={x,y,(rand()%100)/50.0},b={x+1,y,(rand()%100)/50.0},c={x,y+1,(rand()%100)/50.0},d={x+1,y+1,(rand()%100)/50.0};
+			triangles[n]=Qltri(&a,&b,&c);
+			triangles[n]->colour[0]=x*6;
+			triangles[n++]->colour[1]=y*6;
+			triangles[n]=Qltri(&b,&d,&c);
+			triangles[n]->colour[1]=x*6;
+			triangles[n++]->colour[2]=y*6;
+		}
+	triangles[n]=NULL;
+	raster=Qlraster(W,H,3);
+	cam=Qlcamera(raster,&pos,&dir,0,1,1,0.75,60);
+
+	/*Records the session, as qlloop would: the events of each frame, then the rendered frame*/
+	qlrecord *rec=Qlrecord(FNAME,cam);
+	if(!rec)return -1;
+	for(i=0;i<sizeof(keys)/sizeof(keys[0]);i++)
+	{
+		for(x=0;keys[i][x];x++)
+		{
+			qlrecordevent(rec,keys[i][x]);
+			qlcameractl(cam,keys[i][x]);
+		}
+		qlstep(cam,(const qltri**)triangles);
+		if(qlrecordframe(rec,cam))fail=1;
+	}
+	freeqlrecord(&rec);
+
+	/*Replays it on a fresh camera*/
+	freeqlcamera(&cam);
+	cam=Qlcamera(raster,&pos,&dir,0,1,1,1,1);
+	replay=Qlreplay(FNAME);
+	if(!replay||replay->n!=i||replay->w!=W||replay->h!=H)
+	{
+		printf("Couldn't read the session back!\n");
+		return -1;
+	}
+	qlscene *scene=Qlscene(triangles);
+	const qltri **visible=malloc(sizeof(qltri*)*(n+1));
+	run(replay,cam,QL_REPLAY_EVENTS,triangles,NULL,NULL);
+	report("events",replay);
+	fail|=replay->mismatches!=0;
+	run(replay,cam,QL_REPLAY_STATES,triangles,NULL,NULL);
+	report("states",replay);
+	fail|=replay->mismatches!=0;
+	qlcamerasetorder(cam,QL_ORDER_MORTON,8);
+	run(replay,cam,QL_REPLAY_EVENTS,triangles,scene,visible);
+	report("culled, morton8",replay);
+	fail|=replay->mismatches!=0;
+
+	/*A different image must be caught*/
+	triangles[0]->colour[0]^=0xff;
+	run(replay,cam,QL_REPLAY_EVENTS,triangles,NULL,NULL);
+	if(!replay->mismatches)
+	{
+		printf("A changed image went unnoticed!\n");
+		fail=1;
+	}
+
+	free(visible);
+	freeqlscene(&scene);
+	freeqlreplay(&replay);
+	freeqlcamera(&cam);
+	freeqlraster(&raster);
+	for(i=0;i<n;i++)free(triangles[i]);
+	free(triangles);
+	remove(FNAME);
+	if(fail)return -1;
+	printf("Ok.");
+	return 0;
+}
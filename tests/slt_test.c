@@ -6,8 +6,44 @@
 #include "../src/quicklight.h"
 #include "../src/qslt.h"
 #include "../src/qlrender.h"
+#include "../src/qlreplay.h"
 
-int main()
+/*The session is recorded if a file name is given (replay it with replay_test), from the first frame
+drawn after the scene has finished loading, as frames of a partial scene can't be replayed*/
+const char *recname=NULL;
+qlrecord *rec=NULL;
+
+int onevent(qlscreen *scr,char c,void *arg)
+{
+	if(c==27)return 1;
+	qlrecordevent(rec,c);
+	qlcameractl(scr->cam,c);
+	return 0;
+}
+
+/*Takes the triangles loaded so far before each frame*/
+void onframe(qlscreen *scr,char done,void *arg)
+{
+	if(done)
+	{
+		qltloadframe(arg);
+		if(rec)qlrecordframe(rec,scr->cam);
+		else if(recname&&((qltload*)arg)->complete&&!(rec=Qlrecord(recname,scr->cam)))
+		{
+			printf("Couldn't record to %s\n",recname);
+			recname=NULL;
+		}
+	}
+	else qltloadpoll(arg);
+}
+
+/*Called by the loader thread: makes qlloop draw the new triangles*/
+void onpublish(void *arg)
+{
+	qlscreendirty(arg);
+}
+
+int main(int argc,char **argv)
 {
 	int size=100;
 	int scale=5;
@@ -15,31 +51,36 @@ int main()
 	if(!raster)return -1;
 	qlvect *pos=Qlvect(-3,3,4),*dir=Qlvect(1,-1,0);
 	qlcamera *cam=Qlcamera(raster,pos,dir,-QL_PI/4,5,5,5,10);
-	qltri** triangles=qltToQltriList("build/polgono.slt");
-    if(!triangles)
+	/*The window opens right away, and the scene is drawn as it loads*/
+	qlscreen *scr=Qlscreen(cam,scale,"Quicklight");
+	if(!scr)
 	{
-        printf("polgono.slt not found!\n");
+		printf("Could not open a window.\n");
 		return -1;
 	}
-    else printf("polgono.slt imported. Length: %d\n",qllen((void**)triangles));
-	qlscreen *scr=Qlscreen(cam,scale,"Quicklight");
-
-	int cy=0,cyc=15000;
-	struct timespec tim, tim2;
-	tim.tv_sec = 0;
-   	tim.tv_nsec = 1;
-	while(cy<cyc) {
-		qlrender(scr,triangles);
-		char c=qlevent(scr);
-		qlcameractl(cam,c);
-		nanosleep(&tim,&tim2);
-		cy++;
+	qltload *load=Qltload("build/polgono.slt",64,onpublish,scr);
+	if(!load)
+	{
+		printf("polgono.slt not found!\n");
+		freeqlscreen(&scr);
+		return -1;
 	}
+	if(argc>1)recname=argv[1];
+	scr->onframe=onframe;
+	scr->onframearg=load;
+
+	/*Renders only when the camera moves or triangles arrive, at most 30 frames per second. Escape quits.*/
+	qlloop(scr,load->scene.tris,onevent,NULL,30);
+	printf("polgono.slt imported. Length: %d. First frame after %.1fms, whole scene after %.1fms\n",
+		load->scene.len,load->firstframe/1e6,load->fullframe/1e6);
 
+	/*The loader is freed first, as its thread may still be marking the screen dirty*/
+	freeqltload(&load);
+	freeqlscreen(&scr);
+	freeqlrecord(&rec);
 	freeqlcamera(&cam);
 	freeqlraster(&raster);
 	free(pos);free(dir);
-	freeqltriarray(&triangles);
 	printf("Ok.");
 	return 0;
 }
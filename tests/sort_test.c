@@ -0,0 +1,114 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../src/quicklight.h"
+#include "../src/qlscene.h"
+#include "../src/qlstats.h"
+
+/*
+Flies over a terrain scattered with small triangles, tracing every frame both from the culled list (qlscenecull)
+and front to back with early ray termination (qlscenesort). The image and the depth must match in every frame.
+Prints the time per frame of each, and the triangles visited per ray when built with -DQL_STATS.
+*/
+
+#define GRID 50 /*The terrain has GRID*GRID*2 triangles*/
+#define CLUTTER 3000
+#define W 48
+#define H 36
+
+/*Traces a frame of the camera, from the culled list or sorted, and returns how long it took*/
+unsigned long long frame(qlcamera *cam,const qlscene *scene,const qltri **visible,qlsorted *sorted,char sort)
+{
+	unsigned long long t=qlstatsnow();
+	if(sort)
+	{
+		qlscenesort(scene,cam,sorted);
+		qltracerowssorted(cam,sorted,0,H);
+	}
+	else
+	{
+		qlscenecull(scene,cam,visible);
+		qltracerows(cam,visible,0,H);
+	}
+	return qlstatsnow()-t;
+}
+
+int main()
+{
+	int x,y,i,f,k,fail=0,ntriangles=0;
+	unsigned long long t[2]={0,0},tests[2]={0,0},rays[2]={0,0};
+	qlstats stats;
+	qltri *triangles[GRID*GRID*2+CLUTTER+1];
+	const char keys[]="wwwwwwwwwwqqqqwwwwwwffffwwwwwwwweeeeeeeewwwwwwrrrrrrrrwwwwwwaaaassss";
+	srand(2);
+	for(y=0;y<GRID;y++)
+		for(x=0;x<GRID;x++)
+		{
+			qlvect a={x,y,(rand()%64)/32.0},b={x+1,y,(rand()%64)/32.0},c={x,y+1,(rand()%64)/32.0},d={x+1,y+1,(rand()%64)/32.0};
+			triangles[ntriangles]=Qltri(&a,&b,&c);
+			triangles[ntriangles]->colour[0]=x*5;
+			triangles[ntriangles++]->colour[1]=y*5;
+			triangles[ntriangles]=Qltri(&b,&d,&c);
+			triangles[ntriangles]->colour[1]=x*5;
+			triangles[ntriangles++]->colour[2]=y*5;
+		}
+	for(i=0;i<CLUTTER;i++)
+	{
+		qlvect a={(rand()%(GRID*10))/10.0,(rand()%(GRID*10))/10.0,2+(rand()%40)/10.0};
+		qlvect b={a.x+0.4,a.y,a.z},c={a.x,a.y+0.4,a.z+0.4};
+		triangles[ntriangles]=Qltri(&a,&b,&c);
+		triangles[ntriangles++]->colour[0]=i;
+	}
+	triangles[ntriangles]=NULL;
+
+	qlscene *scene=Qlscene(triangles);
+	qlsorted *sorted=Qlsorted(scene);
+	const qltri **visible=malloc(sizeof(qltri*)*(ntriangles+1));
+	qlraster *culled=Qlraster(W,H,3),*front=Qlraster(W,H,3);
+	qlvect pos={2,2,7},dir={1,1,-0.4};
+	qlcamera *culledcam=Qlcamera(culled,&pos,&dir,0,1,1,0.75,4*GRID);
+	qlcamera *frontcam=Qlcamera(front,&pos,&dir,0,1,1,0.75,4*GRID);
+
+	for(f=0;keys[f];f++)
+	{
+		for(i=0;i<2;i++)
+		{
+			qlcameractl(culledcam,keys[f]);
+			qlcameractl(frontcam,keys[f]);
+		}
+		/*Each way is traced in a frame of its own, to count them apart*/
+		for(k=0;k<2;k++)
+		{
+			t[k]+=frame(k?frontcam:culledcam,scene,visible,sorted,k);
+			qlstatsframe();
+			qlstatslast(&stats);
+			tests[k]+=stats.tritests;
+			rays[k]+=stats.rays;
+		}
+		/*Rays through the terrain's shared edges hit two triangles at the same distance, which must resolve the same way*/
+		if(memcmp(culled->z,front->z,sizeof(double)*W*H)||memcmp(culled->data,front->data,W*H*3))
+		{
+			printf("Frame %d differs!\n",f);
+			fail=1;
+		}
+	}
+
+	printf("%d triangles, %d frames of %dx%d\n",ntriangles,f,W,H);
+	printf("Culled: %.2fms per frame",t[0]/1e6/f);
+	if(rays[0])printf(", %.1f triangles visited per ray",(double)tests[0]/rays[0]);
+	printf("\nFront to back: %.2fms per frame",t[1]/1e6/f);
+	if(rays[1])printf(", %.1f triangles visited per ray",(double)tests[1]/rays[1]);
+	printf("\n");
+
+	freeqlsorted(&sorted);
+	freeqlscene(&scene);
+	free(visible);
+	freeqlcamera(&culledcam);
+	freeqlcamera(&frontcam);
+	freeqlraster(&culled);
+	freeqlraster(&front);
+	for(i=0;i<ntriangles;i++)free(triangles[i]);
+	if(fail)return -1;
+	printf("Ok.");
+	return 0;
+}
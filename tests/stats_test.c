@@ -0,0 +1,84 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../src/quicklight.h"
+#include "../src/qlscene.h"
+#include "../src/qlstats.h"
+
+/*
+Renders a wall with a small triangle far behind it, through qlstep and front to back, and checks that the
+counters report what was traced: a ray per pixel, a test per ray and triangle (or an early out per ray when
+sorted), and time spent tracing. Then checks that qlstatsdump writes them.
+buildtests.sh always builds it with -DQL_STATS.
+*/
+
+#ifndef QL_STATS
+#error "stats_test needs the library built with -DQL_STATS"
+#endif
+
+#define W 32
+#define H 24
+#define NTRIS 3
+
+int main()
+{
+	int i,fail=0;
+	char expected[64],*text;
+	size_t len;
+	FILE *f;
+	qlstats stats;
+	qlvect wall[4]={{10,-20,-20},{10,20,-20},{10,20,20},{10,-20,20}};
+	qlvect far[3]={{100,0,0},{100,1,0},{100,0,1}};
+	qltri *triangles[NTRIS+1]={Qltri(&wall[0],&wall[1],&wall[2]),Qltri(&wall[0],&wall[2],&wall[3]),Qltri(&far[0],&far[1],&far[2]),NULL};
+	qlraster *raster=Qlraster(W,H,3);
+	qlvect pos={0,0,0},dir={1,0,0};
+	qlcamera *cam=Qlcamera(raster,&pos,&dir,0,1,1,0.75,1000);
+	qlscene *scene=Qlscene(triangles);
+	qlsorted *sorted=Qlsorted(scene);
+
+	/*Every ray tests every triangle, and hits the wall*/
+	qlstatsframe();
+	qlstep(cam,(const qltri**)triangles);
+	qlstatsframe();
+	qlstatslast(&stats);
+	if(stats.frames!=1||stats.rays!=W*H||stats.tritests!=W*H*NTRIS||stats.planehits+stats.planemiss!=stats.tritests||
+		stats.intri<W*H||!stats.ns[QL_STAGE_TRACE]||!stats.ns[QL_STAGE_SHADE])
+	{
+		printf("qlstep's counters are wrong: ");
+		qlstatsdump(stdout,&stats,0);
+		fail=1;
+	}
+
+	/*Sorted, every ray stops before the far triangle*/
+	qlscenesort(scene,cam,sorted);
+	qlstepsorted(cam,sorted);
+	qlstatsframe();
+	qlstatslast(&stats);
+	if(stats.rays!=W*H||stats.earlyout!=W*H||!stats.tritests||stats.tritests>=W*H*NTRIS)
+	{
+		printf("qlstepsorted's counters are wrong: ");
+		qlstatsdump(stdout,&stats,0);
+		fail=1;
+	}
+
+	/*Both dump formats carry the counters*/
+	f=open_memstream(&text,&len);
+	qlstatsdump(f,&stats,0);
+	qlstatsdump(f,&stats,1);
+	fclose(f);
+	sprintf(expected,"rays %d tritests %llu",W*H,stats.tritests);
+	if(!strstr(text,expected))fail=1;
+	sprintf(expected,"\"rays\":%d,\"tritests\":%llu",W*H,stats.tritests);
+	if(!strstr(text,expected))fail=1;
+	printf("%s",text);
+	free(text);
+
+	freeqlsorted(&sorted);
+	freeqlscene(&scene);
+	freeqlcamera(&cam);
+	freeqlraster(&raster);
+	for(i=0;i<NTRIS;i++)free(triangles[i]);
+	if(fail)return -1;
+	printf("Ok.");
+	return 0;
+}
@@ -0,0 +1,124 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <sys/socket.h>
+#include "../src/quicklight.h"
+#include "../src/qslt.h"
+#include "../src/qlstream.h"
+
+/*
+Streams a short flythrough over a Unix socket to a client in a child process.
+The client sends back a checksum of every frame it decodes, which must match the rendered one.
+Midway the client switches its image to the packed formats, as Qlscreen does on TrueColor displays.
+Then feeds a client frame headers through a socket pair: one too large to allocate must be rejected.
+*/
+
+#define ADDR "unix:build/stream_test.sock"
+
+/*Writes a frame header with no tiles to fd*/
+void header(int fd,unsigned int w,unsigned int h)
+{
+	unsigned char b[20]="QLFB";
+	unsigned int v[4]={w,h,QL_STREAM_KEY,0};
+	int i,j;
+	for(i=0;i<4;i++)
+		for(j=0;j<4;j++)b[4+i*4+j]=v[i]>>(j*8);
+	if(write(fd,b,20)!=20)printf("Could not write a header.\n");
+}
+
+unsigned long checksum(const qlraster *r)
+{
+	unsigned long h=5381;
+	unsigned char rgb[3];
+	int i;
+	for(i=0;i<r->w*r->h;i++)
+	{
+		qlgetpixel(r,i,rgb);
+		h=h*33+rgb[0]+(rgb[1]<<8)+(rgb[2]<<16);
+	}
+	return h;
+}
+
+int main()
+{
+	int size=100,frames=30,i,fail=0;
+	int fds[2];
+	unsigned long sum;
+	const char keys[]="wwwwwqqqqq                    ";
+	qltri** triangles=qltToQltriList("build/polgono.slt");
+	if(!triangles)
+	{
+		printf("polgono.slt not found!\n");
+		return -1;
+	}
+	qlstream *stream=Qlstream(ADDR);
+	if(!stream||pipe(fds))
+	{
+		printf("Could not open the stream.\n");
+		return -1;
+	}
+	if(!fork())
+	{
+		qlstreamclient *client=Qlstreamclient(ADDR);
+		close(fds[0]);
+		if(!client)return -1;
+		for(i=0;qlstreamrecv(client)>=0;i++)
+		{
+			sum=checksum(client->image);
+			if(write(fds[1],&sum,sizeof(sum))!=sizeof(sum))break;
+			/*Switching formats clears the image, and the next frame (a delta) must still come out whole*/
+			if(i==4)qlrastersetformat(client->image,QL_XRGB32);
+			if(i==14)qlrastersetformat(client->image,QL_XBGR32);
+		}
+		freeqlstreamclient(&client);
+		return 0;
+	}
+	close(fds[1]);
+	qlraster *raster=Qlraster(size,size,4);
+	qlvect *pos=Qlvect(-3,3,4),*dir=Qlvect(1,-1,0);
+	qlcamera *cam=Qlcamera(raster,pos,dir,-QL_PI/4,5,5,5,10);
+	qlstreamaccept(stream,1);
+	for(i=0;i<frames;i++)
+	{
+		qlcameractl(cam,keys[i]);
+		qlstep(cam,(const qltri**)triangles);
+		qlstreamframe(stream,raster);
+		if(read(fds[0],&sum,sizeof(sum))!=sizeof(sum)||sum!=checksum(raster))
+		{
+			printf("Frame %d: client image differs!\n",i);
+			fail=1;
+			break;
+		}
+		printf("Frame %d: %llu bytes (raw frame: %d bytes)\n",i,stream->framebytes,size*size*3);
+	}
+	freeqlstream(&stream);
+	wait(NULL);
+
+	/*w*h*3 of a 65535x65535 frame overflows 32 bits*/
+	qlstreamclient *client=malloc(sizeof(qlstreamclient));
+	if(socketpair(AF_UNIX,SOCK_STREAM,0,fds))return -1;
+	client->fd=fds[0];
+	client->image=NULL;
+	client->prev=NULL;
+	client->fmt=QL_RGB24;
+	client->s=3;
+	client->buf=malloc(1);
+	header(fds[1],64,48);
+	header(fds[1],65535,65535);
+	if(qlstreamrecv(client)!=0||client->image->w!=64||qlstreamrecv(client)!=-1)
+	{
+		printf("A frame too large was accepted!\n");
+		fail=1;
+	}
+	close(fds[1]);
+	freeqlstreamclient(&client);
+	freeqlcamera(&cam);
+	freeqlraster(&raster);
+	free(pos);free(dir);
+	freeqltriarray(&triangles);
+	if(fail)return -1;
+	printf("Ok.");
+	return 0;
+}
@@ -0,0 +1,62 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "../src/quicklight.h"
+#include "../src/qlrender.h"
+#include "../src/qlstream.h"
+
+/*
+Reference viewer for qlstream.
+Usage: stream_viewer.c.out <address> [scale]
+e.g. stream_viewer.c.out tcp:renderhost:7070 5
+*/
+
+int main(int argc,char **argv)
+{
+	if(argc<2)
+	{
+		printf("Usage: %s <unix:path|tcp:host:port> [scale]\n",argv[0]);
+		return -1;
+	}
+	int i,scale=argc>2?atoi(argv[2]):1;
+	unsigned char rgb[3];
+	qlraster *shown=NULL;
+	qlcamera *cam=NULL;
+	qlscreen *scr=NULL;
+	qlvect pos={0,0,0},dir={1,0,0};
+	qlstreamclient *client=Qlstreamclient(argv[1]);
+	if(!client)
+	{
+		printf("Could not connect to %s\n",argv[1]);
+		return -1;
+	}
+	while(qlstreamrecv(client)>=0)
+	{
+		/*
+		qlstreamrecv reallocates the received image when the stream's frame size changes,
+		so the camera only carries a copy of it to the screen, and both are made again for the new size
+		*/
+		if(!shown||shown->w!=client->image->w||shown->h!=client->image->h)
+		{
+			freeqlscreen(&scr);
+			freeqlcamera(&cam);
+			freeqlraster(&shown);
+			shown=Qlraster(client->image->w,client->image->h,3);
+			cam=Qlcamera(shown,&pos,&dir,0,1,1,1,1);
+			scr=Qlscreen(cam,scale,"Quicklight viewer");
+			if(!scr)return -1;
+		}
+		for(i=0;i<shown->w*shown->h;i++)
+		{
+			qlgetpixel(client->image,i,rgb);
+			qlputpixel(shown,i,rgb[0],rgb[1],rgb[2]);
+		}
+		qlpresent(scr);
+		if(qlevent(scr)=='q')break;
+	}
+	freeqlscreen(&scr);
+	freeqlcamera(&cam);
+	freeqlraster(&shown);
+	freeqlstreamclient(&client);
+	printf("Ok.");
+	return 0;
+}
@@ -0,0 +1,233 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "../src/quicklight.h"
+#include "../src/qlstats.h"
+
+/*
+Per-ray cost of the tracer.
+Traces a random scene with qltracerows, and with a verbatim copy of the tracer as it was before the inline
+vector maths of qlvect.h: out-of-line pointer functions working through thread-local temporaries.
+Both must produce the same image.
+Build with optimizations for meaningful numbers: QLFLAGS=-O2 source buildtests.sh
+*/
+
+#define TRIS 400
+#define SIZE 120
+#define FRAMES 10
+
+/*
+The previous vector functions, renamed. They lived in another translation unit,
+so they are kept out of line here too.
+*/
+#define OLD __attribute__((noinline))
+
+_Thread_local qlvect _oldgp0={0,0,0};
+_Thread_local qlvect _oldgp1={0,0,0};
+_Thread_local qlvect _oldgp2={0,0,0};
+_Thread_local qlvect _oldgp3={0,0,0};
+_Thread_local qlvect _oldgp4={0,0,0};
+_Thread_local qlvect _oldgpm0={0,0,0};
+_Thread_local qlvect _oldgpm1={0,0,0};
+
+OLD double oldscproduct(const qlvect *a,const qlvect *b)
+{
+    if(!a||!b)return -1;
+    return a->x*b->x+a->y*b->y+a->z*b->z;
+}
+
+OLD void oldvectproduct(const qlvect *a,const qlvect *b,qlvect *c)
+{
+    if(!a||!b||!c)return;
+    qlvect *temp=&_oldgp4;
+    temp->x=a->y*b->z-a->z*b->y;
+    temp->y=a->z*b->x-a->x*b->z;
+    temp->z=a->x*b->y-a->y*b->x;
+    c->x=temp->x;
+    c->y=temp->y;
+    c->z=temp->z;
+}
+
+OLD void oldvectscale(const qlvect *a,double s,qlvect *b)
+{
+    if(!a||!b)return;
+    b->x=a->x*s;
+    b->y=a->y*s;
+    b->z=a->z*s;
+}
+
+OLD void oldvectsum(const qlvect *a,const qlvect *b, qlvect *c)
+{
+    if(!a||!b||!c)return;
+    c->x=a->x+b->x;
+    c->y=a->y+b->y;
+    c->z=a->z+b->z;
+}
+
+OLD void oldvectsub(const qlvect *a,const qlvect *b, qlvect *c)
+{
+    if(!a||!b||!c)return;
+    c->x=a->x-b->x;
+    c->y=a->y-b->y;
+    c->z=a->z-b->z;
+}
+
+OLD void oldvectnormalize(qlvect *a)
+{
+    double sf=sqrt(oldscproduct(a,a));
+    a->x=a->x/sf;
+    a->y=a->y/sf;
+    a->z=a->z/sf;
+}
+
+OLD double oldvectintersectv(const qlvect *pos,const qlvect *dir,const qlvect *a,const qlvect *b,const qlvect *c)
+{
+    if(!pos||!dir||!a||!b||!c)return 0;
+    qlvect *result=&_oldgp0;
+    qlvect *normal=&_oldgp1;
+    qlvect *edge1=&_oldgp2;
+    qlvect *edge2=&_oldgp3;
+    double s;
+    /*First we calculate the vectors corresponding to the edges of the triangle*/
+    oldvectsub(a,b,edge1);
+    oldvectsub(a,c,edge2);
+    /*Then the normal*/
+    oldvectproduct(edge1,edge2,normal);
+    s=oldscproduct(dir,normal);
+    /*If the vector is parallel to the plane*/
+    if(s==0)return INFINITY;
+    oldvectsub(a,pos,result);
+    s=oldscproduct(result,normal)/s;
+    return s;
+}
+
+OLD double oldvectintersect(const qlvect *pos,const qlvect *dir,const qltri *t)
+{
+    if(!t)return 0;
+    return oldvectintersectv(pos,dir,&t->a,&t->b,&t->c);
+}
+
+OLD char oldvectintriv(const qlvect *p,const qlvect *a,const qlvect *b,const qlvect *c)
+{
+    if(!p||!a||!b||!c)return -1;
+    /*A vector representing the edge we are currently analysing*/
+    qlvect *edge=&_oldgp0;
+    /*A vector starting on the first vertex of the edge and ending on our point*/
+    qlvect *vp=&_oldgp1;
+    /*A normal vector. We'll use it for checking if the other vectors point roughly towards the same direction*/
+    qlvect *normal=&_oldgp2;
+    /*Result vector*/
+    qlvect *result=&_oldgp3;
+    double reference;/*Scalar product of the first vector and the normal vector*/
+    /*AB edge*/
+    oldvectsub(a,b,edge);
+
+    /*We'll use this opportunity to calculate the normal vector, too*/
+    oldvectsub(a,c,vp);
+    oldvectproduct(vp,edge,normal);
+
+    oldvectsub(p,a,vp);
+    oldvectproduct(vp,edge,result);
+    reference=oldscproduct(result,normal);
+    /*BC edge*/
+    oldvectsub(b,c,edge);
+    oldvectsub(p,b,vp);
+    oldvectproduct(vp,edge,result);
+    if(oldscproduct(result,normal)*reference<0)return 0;
+    /*CA edge*/
+    oldvectsub(c,a,edge);
+    oldvectsub(p,c,vp);
+    oldvectproduct(vp,edge,result);
+    if(oldscproduct(result,normal)*reference<0)return 0;
+    return 1;
+}
+
+OLD char oldvectintri(const qlvect *a,const qltri *t)
+{
+    if(!t)return -1;
+    return oldvectintriv(a,&t->a,&t->b,&t->c);
+}
+
+/*The previous qlcalcray (without the instrumentation counters)*/
+void oldcalcray(qlray *ray,const qltri**triangles)
+{
+    int i=0;
+    double s;
+    double min=INFINITY;
+    qlvect *pos=&_oldgpm0,*dir=&_oldgpm1;
+    if(!ray||!triangles)return;
+    int p=ray->rx+ray->ry*ray->screen->w;
+    while(triangles[i]!=NULL)
+    {
+        *dir=ray->dir;
+        oldvectnormalize(dir);
+        s=oldvectintersect(&ray->pos,dir,triangles[i]);
+        if(s>=0&&s<min&&s<ray->depth)
+        {
+            oldvectscale(dir,s,dir);
+            oldvectsum(&ray->pos,dir,pos);
+            if(oldvectintri(pos,triangles[i]))
+            {
+                min=s;
+                qlputpixel(ray->screen,p,triangles[i]->colour[0],triangles[i]->colour[1],triangles[i]->colour[2]);
+            }
+        }
+        i++;
+    }
+    ray->screen->z[p]=min;
+    if(min>ray->depth)qlputpixel(ray->screen,p,0,0,0);
+}
+
+int main()
+{
+	int i,f;
+	unsigned long long t;
+	double now,old;
+	unsigned char *data;
+	double *z;
+	qltri *triangles[TRIS+1];
+	srand(1);
+	for(i=0;i<TRIS;i++)
+	{
+		qlvect a={rand()%40-20,rand()%40-20,rand()%20-10};
+		qlvect b={a.x+rand()%5-2,a.y+rand()%5-2,a.z+rand()%5-2};
+		qlvect c={a.x+rand()%5-2,a.y+rand()%5-2,a.z+rand()%5-2};
+		triangles[i]=Qltri(&a,&b,&c);
+		triangles[i]->colour[0]=triangles[i]->colour[1]=triangles[i]->colour[2]=200;
+	}
+	triangles[TRIS]=NULL;
+	qlraster *raster=Qlraster(SIZE,SIZE,3);
+	qlvect pos={-25,0,0},dir={1,0,0};
+	qlcamera *cam=Qlcamera(raster,&pos,&dir,0,2,4,4,60);
+
+	t=qlstatsnow();
+	for(f=0;f<FRAMES;f++)qltracerows(cam,(const qltri**)triangles,0,SIZE);
+	now=(double)(qlstatsnow()-t)/(FRAMES*SIZE*SIZE);
+	data=malloc(SIZE*SIZE*3);
+	z=malloc(sizeof(double)*SIZE*SIZE);
+	memcpy(data,raster->data,SIZE*SIZE*3);
+	memcpy(z,raster->z,sizeof(double)*SIZE*SIZE);
+
+	t=qlstatsnow();
+	for(f=0;f<FRAMES;f++)
+		for(i=0;i<SIZE*SIZE;i++)oldcalcray(cam->rays[i],(const qltri**)triangles);
+	old=(double)(qlstatsnow()-t)/(FRAMES*SIZE*SIZE);
+
+	printf("%d triangles, %d rays per frame\n",TRIS,SIZE*SIZE);
+	printf("qltracerows:     %8.1f ns/ray %6.2f ns/ray-triangle test\n",now,now/TRIS);
+	printf("previous tracer: %8.1f ns/ray %6.2f ns/ray-triangle test (%.2fx slower)\n",old,old/TRIS,old/now);
+	if(memcmp(data,raster->data,SIZE*SIZE*3)||memcmp(z,raster->z,sizeof(double)*SIZE*SIZE))
+	{
+		printf("The previous tracer's image differs!\n");
+		return -1;
+	}
+	free(data);
+	free(z);
+
+	for(i=0;i<TRIS;i++)free(triangles[i]);
+	freeqlcamera(&cam);
+	freeqlraster(&raster);
+	printf("Ok.");
+	return 0;
+}